@@ -0,0 +1,127 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace jnp1::detail{
+
+// Blocked Bloom filter over element hashes (see hashBytes()). All bits of one element fall into a single
+// 512-bit block, so a query touches exactly one cache line. Elements cannot be removed; the owner counts removals
+// and rebuilds the filter once they make it too inaccurate (see stale()).
+class BloomFilter{
+    public:
+    static constexpr size_t defaultBitsPerElement = 10;
+
+    // Sizes the filter for capacity elements.
+    BloomFilter(size_t bitsPerElement, size_t capacity):
+        bitsPerElement(std::max<size_t>(bitsPerElement, 1)),
+        capacity(std::max<size_t>(capacity, minCapacity)),
+        hashCount(std::clamp<size_t>(this->bitsPerElement * 69 / 100, 1, maxHashCount)) {
+        resize();
+    }
+
+    void add(uint64_t h){
+        uint64_t* block = blockOf(h);
+        uint64_t bits = remix(h);
+        for(size_t i = 0; i < hashCount; i++, bits >>= 9){
+            block[(bits >> 6) & (blockWords - 1)] |= 1ULL << (bits & 63);
+        }
+        elements++;
+    }
+
+    // False means h is definitely not in the set.
+    bool mayContain(uint64_t h) const{
+        const uint64_t* block = blockOf(h);
+        uint64_t bits = remix(h);
+        for(size_t i = 0; i < hashCount; i++, bits >>= 9){
+            if((block[(bits >> 6) & (blockWords - 1)] & (1ULL << (bits & 63))) == 0){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void removed(){
+        removals++;
+    }
+
+    void clear(){
+        std::fill(words.begin(), words.end(), 0);
+        elements = 0;
+        removals = 0;
+    }
+
+    // Empties the filter and sizes it for capacity elements. The owner is expected to add all elements again.
+    // Statistics are kept.
+    void rebuild(size_t capacity){
+        this->capacity = std::max(capacity, minCapacity);
+        elements = 0;
+        removals = 0;
+        resize();
+        rebuilds++;
+    }
+
+    // True if the filter should be rebuilt for a set of given size: either it holds more elements than it was
+    // sized for or removed elements make up a large part of it.
+    bool stale(size_t setSize) const{
+        return setSize > capacity || (removals > minCapacity && removals > elements / 2);
+    }
+
+    size_t bits() const{
+        return words.size() * 64;
+    }
+
+    size_t bitsPerElementSetting() const{
+        return bitsPerElement;
+    }
+
+    // Statistics of queries, updated by the set owning the filter. Queries run concurrently, hence atomics.
+    mutable std::atomic<size_t> queries{0};
+    mutable std::atomic<size_t> rejected{0};
+    mutable std::atomic<size_t> falsePositives{0};
+    size_t rebuilds = 0;
+
+    private:
+    static constexpr size_t blockBits = 512;
+    static constexpr size_t blockWords = blockBits / 64;
+    static constexpr size_t maxHashCount = 7;  // each hash uses 9 bits of remix()
+    static constexpr size_t minCapacity = 64;
+
+    size_t bitsPerElement;
+    size_t capacity;
+    size_t hashCount;
+    size_t elements = 0;
+    size_t removals = 0;
+    std::vector<uint64_t> words;
+
+    void resize(){
+        size_t blocks = (capacity * bitsPerElement + blockBits - 1) / blockBits;
+        words.assign(blocks * blockWords, 0);
+    }
+
+    // Block is selected by high bits of the hash, which flat tables use the least.
+    const uint64_t* blockOf(uint64_t h) const{
+        size_t blocks = words.size() / blockWords;
+        return words.data() + (size_t) (((h >> 32) * blocks) >> 32) * blockWords;
+    }
+
+    uint64_t* blockOf(uint64_t h){
+        return const_cast<uint64_t*>(static_cast<const BloomFilter*>(this)->blockOf(h));
+    }
+
+    static uint64_t remix(uint64_t h){
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+}
+
+#endif /* BLOOM_H */
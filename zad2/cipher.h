@@ -0,0 +1,89 @@
+#ifndef CIPHER_H
+#define CIPHER_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace jnp1::detail{
+
+// Key of the XOR cipher, expanded so that values can be encrypted a machine word at a time.
+//
+// Pattern holds the key repeated to at least length + 8 bytes, so 8 bytes of key stream starting at any
+// position inside the key can be read from it with one load. After each word the position advances by 8 modulo
+// length, which is precomputed as step. Empty key means no encryption.
+class XorKey{
+    public:
+    XorKey() = default;
+
+    explicit XorKey(std::string_view key){
+        assign(key);
+    }
+
+    // Reuses the pattern buffer, so assigning keys of similar length does not allocate.
+    void assign(std::string_view key){
+        length = key.size();
+        text.assign(key);
+        pattern.clear();
+        if(length == 0){
+            return;
+        }
+        while(pattern.size() < length + wordSize){
+            pattern.append(key);
+        }
+        step = wordSize % length;
+    }
+
+    bool empty() const{
+        return length == 0;
+    }
+
+    // Key as it was given.
+    std::string_view original() const{
+        return text;
+    }
+
+    // Stores value encrypted with the key in out.
+    void encrypt(std::string_view value, std::string& out) const{
+        out.resize(value.size());
+        if(length == 0){
+            std::memcpy(out.data(), value.data(), value.size());
+            return;
+        }
+
+        const char* in = value.data();
+        char* dst = out.data();
+        size_t n = value.size();
+        size_t pos = 0;
+        size_t i = 0;
+        for(; i + wordSize <= n; i += wordSize){
+            uint64_t v, k;
+            std::memcpy(&v, in + i, wordSize);
+            std::memcpy(&k, pattern.data() + pos, wordSize);
+            v ^= k;
+            std::memcpy(dst + i, &v, wordSize);
+            pos += step;
+            if(pos >= length){
+                pos -= length;
+            }
+        }
+        for(size_t j = 0; i < n; i++, j++){
+            dst[i] = in[i] ^ pattern[pos + j];
+        }
+    }
+
+    private:
+    static constexpr size_t wordSize = sizeof(uint64_t);
+
+    size_t length = 0;
+    size_t step = 0;
+    std::string text;
+    std::string pattern;
+};
+
+}
+
+#endif /* CIPHER_H */
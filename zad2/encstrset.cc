@@ -1,26 +1,59 @@
 #include "encstrset.h"
+#include "bloom.h"
+#include "cipher.h"
+#include "flatset.h"
+#include "frozenset.h"
+#include "interned.h"
+#include "logging.h"
+#include "ordered.h"
+#include "partitioned.h"
+#include "reclaim.h"
+#include "stats.h"
 
-#include <iostream>
-#include <iomanip>
-#include <unordered_map>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
-using std::unordered_map;
-using std::unordered_set;
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::vector;
 using std::string;
-using std::ostream;
-using std::stringstream;
+using std::string_view;
 
-using std::cout;
-using std::cerr;
-using std::endl;
-// We also use std::hex, std::uppercase, std::setw and std::setfill but they are used exactly once.
-// They also have quite ambiguous names so we leave std:: prefix to better indicate that they are indeed the library ones.
-// Similarly, we leave std::get as is to better indicate that it is the get extracting values from tuples.
+using jnp1::detail::LogLevel;
+using jnp1::detail::logLine;
+using jnp1::detail::logCall;
+using jnp1::detail::Quoted;
+using jnp1::detail::quoted;
+using jnp1::detail::cypher;
 
+using jnp1::detail::SetStorage;
+using jnp1::detail::FlatTable;
+using jnp1::detail::FlatView;
+using jnp1::detail::FrozenSet;
+using jnp1::detail::InternPool;
+using jnp1::detail::InternedSet;
+using jnp1::detail::MemoryUsage;
+using jnp1::detail::OrderedSet;
+using jnp1::detail::PartitionedSet;
+using jnp1::detail::Reclaimer;
+using jnp1::detail::BloomFilter;
+using jnp1::detail::XorKey;
 
-using StringSet = unordered_set<string>;
-using SetMap = unordered_map<unsigned long, StringSet>;
+// Representation of newly created sets and of sets that get modified.
+using StringSet = jnp1::detail::FlatSet;
 
 namespace{
 
@@ -30,217 +63,1623 @@ namespace{
     const bool _debug = true;
 #endif
 
-SetMap& setCollection(){
-    static SetMap map;
-    return map;
+#ifdef ENCSTRSET_STATS
+    const bool _stats = true;
+#else
+    const bool _stats = false;
+#endif
+
+using Stats = jnp1::detail::CallStats<jnp1::ENCSTRSET_FN_COUNT>;
+
+// Counts a call of a function and measures how long it takes, from construction to destruction. Calls that reach
+// hit() count as hits. Compiles to nothing without ENCSTRSET_STATS.
+class CallTimer{
+    public:
+    explicit CallTimer(jnp1::encstrset_function function):
+        function(function) {
+        if(_stats) start = std::chrono::steady_clock::now();
+    }
+
+    CallTimer(const CallTimer&) = delete;
+    CallTimer& operator=(const CallTimer&) = delete;
+
+    ~CallTimer(){
+        if(_stats){
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            Stats::local().record(function, success,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+
+    void hit(){
+        success = true;
+    }
+
+    private:
+    jnp1::encstrset_function function;
+    bool success = false;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Kinds of sets, differing in the representation their contents are kept in once modified.
+enum class SetKind{
+    flat,       // StringSet, split into partitions when large (see mutableSet())
+    interned,   // InternedSet (see encstrset_new_interned())
+    ordered     // OrderedSet (see encstrset_new_ordered())
+};
+
+// Sets live in slots. Slots of deleted sets are put on a free list and reused by encstrset_new().
+// Id of a set keeps the slot index in its lower half and the slot generation in its upper half. Generation is bumped
+// whenever a set is deleted, so an id of a deleted set never resolves to the set that later reuses its slot.
+// Every slot has its own reader/writer lock guarding all of its fields, so operations on different sets never
+// wait for each other and tests on the same set run concurrently.
+// Contents of a set may be shared with other sets after encstrset_copy. Shared contents are never modified, a set
+// gets its own copy right before its first mutation (see mutableSet()).
+struct SetSlot{
+    std::shared_mutex mutex;
+    unsigned long generation = 0;
+    bool alive = false;
+    // Frozen sets reject all modifications until thawed (see encstrset_freeze()).
+    bool frozen = false;
+    SetKind kind = SetKind::flat;
+    std::shared_ptr<SetStorage> set;
+    // Optional filter answering most tests of absent elements without probing set.
+    std::unique_ptr<BloomFilter> bloom;
+};
+
+using ReadLock = std::shared_lock<std::shared_mutex>;
+using WriteLock = std::unique_lock<std::shared_mutex>;
+
+const unsigned indexBits = sizeof(unsigned long) * CHAR_BIT / 2;
+const unsigned long indexMask = (1UL << indexBits) - 1;
+// Slot indices have to fit in indexBits bits of an id. The greatest one is left unused, so that no id equals
+// ENCSTRSET_NO_SET.
+const size_t maxSlots = indexMask;
+
+// Slots are allocated in chunks that never move, so a slot found without locking stays valid forever.
+const unsigned chunkBits = 10;
+const size_t chunkSize = 1UL << chunkBits;
+
+// Directory maps chunk number to chunk. It is published RCU-style: growing the registry builds a new directory
+// and swaps the atomic pointer, so readers resolve ids without taking any lock. Replaced directories are tiny and are
+// kept until exit, which makes it safe for readers to keep using a directory they loaded before the swap.
+using SlotDirectory = vector<SetSlot*>;
+
+struct SlotRegistry{
+    std::mutex mutex;
+    std::atomic<const SlotDirectory*> directory{nullptr};
+    vector<std::unique_ptr<SetSlot[]>> chunks;
+    vector<std::unique_ptr<SlotDirectory>> directories;
+    size_t usedSlots = 0;
+    vector<size_t> freeSlots;
+};
+
+SlotRegistry& registry(){
+    static SlotRegistry reg;
+    return reg;
+}
+
+unsigned long makeId(size_t index, unsigned long generation){
+    return (generation << indexBits) | index;
 }
 
-ostream& err() {
-    static std::ios_base::Init init;
-    return std::cerr;
+// Returns slot the id points to or nullptr if there is no such slot. Does not lock anything, so the slot has to be
+// locked and checked with holdsSet() before use.
+SetSlot* findSlot(unsigned long id){
+    size_t index = id & indexMask;
+    const SlotDirectory* dir = registry().directory.load(std::memory_order_acquire);
+    if(dir == nullptr || (index >> chunkBits) >= dir->size()){
+        return nullptr;
+    }
+    return &(*dir)[index >> chunkBits][index & (chunkSize - 1)];
 }
 
+// Must be called with slot locked.
+bool holdsSet(const SetSlot& slot, unsigned long id){
+    return slot.alive && makeId(id & indexMask, slot.generation) == id;
+}
 
-// We will use this overload to print quoted strings. This avoids the need to create unnecessary temporary strings
-// and allows to keep error messages concise - if c is of type char* it is enough to write
-//      cerr << &c << " rest of the message";
-// and content of c will be quoted. We could not overload << for just char*, because then every literal string in our code
-// would be quoted.
-ostream& operator<<(ostream& stream, const char ** c){
-    if(*c){
-        stream << '"' << *c << '"';
-    } else {
-        stream << "NULL";
+// Returns slot of set with given id locked with lock or nullptr if there is no such set. Lock is left untouched
+// in the latter case. Costs one bounds check and two array indexes on top of locking.
+template <class Lock>
+SetSlot* lockSet(unsigned long id, Lock& lock){
+    SetSlot* slot = findSlot(id);
+    if(slot == nullptr){
+        return nullptr;
     }
-    return stream;
+    Lock slotLock(slot->mutex);
+    if(!holdsSet(*slot, id)){
+        return nullptr;
+    }
+    lock = std::move(slotLock);
+    return slot;
+}
+
+// Returns interned contents or nullptr if contents are of another representation.
+const InternedSet* asInterned(const SetStorage& contents){
+    return dynamic_cast<const InternedSet*>(&contents);
 }
 
-unsigned long freeId = 0;
+InternedSet* asInterned(SetStorage& contents){
+    return dynamic_cast<InternedSet*>(&contents);
+}
+
+const OrderedSet* asOrdered(const SetStorage& contents){
+    return dynamic_cast<const OrderedSet*>(&contents);
+}
 
-// Alias for c++ strlen() equivalent
-const auto& CStringLength = std::char_traits<char>::length;
+// Returns kind of sets whose modified contents are in the representation of contents. Read-only representations
+// (mapped files, frozen sets) count as flat, so whatever the kind of their set, they are replaced when modified.
+SetKind kindOf(const SetStorage& contents){
+    if(asInterned(contents) != nullptr){
+        return SetKind::interned;
+    }
+    if(asOrdered(contents) != nullptr){
+        return SetKind::ordered;
+    }
+    return SetKind::flat;
+}
 
-// Performs encryption. Assumes not null value.
-string xorEncrypt(const char* value, const char* key){
-    string encrypted;
-    if(key == nullptr || *key == '\0'){
-        encrypted = value;
-        return encrypted;
+// Returns empty contents of the representation used by slot's kind of set.
+std::shared_ptr<SetStorage> emptySet(const SetSlot& slot){
+    switch(slot.kind){
+        case SetKind::interned:
+            return std::make_shared<InternedSet>();
+        case SetKind::ordered:
+            return std::make_shared<OrderedSet>();
+        default:
+            return std::make_shared<StringSet>();
     }
-    size_t valueLength = CStringLength(value);
-    size_t keyLength = CStringLength(key);
+}
 
-    for(size_t i = 0; i < valueLength; i++){
-        encrypted += value[i] ^ key[i%keyLength];
+// Returns a writable copy of contents in the representation used by slot's kind of set. Contents of another kind
+// (copied from a set of another kind, or read-only) are converted: ordered sets are built from sorted elements,
+// other kinds element by element.
+std::shared_ptr<SetStorage> copySet(const SetSlot& slot, const SetStorage& contents){
+    if(kindOf(contents) == slot.kind){
+        return contents.clone();
+    }
+    if(slot.kind == SetKind::ordered){
+        return std::make_shared<OrderedSet>(contents);
     }
-    return encrypted;
+    std::shared_ptr<SetStorage> copy = emptySet(slot);
+    copy->reserve(contents.size());
+    contents.forEach([&](string_view s, uint64_t hash){
+        copy->insert(s, hash);
+    });
+    return copy;
 }
 
-string printCypher(const string& encryptedString){
-    stringstream ss;
-    ss << std::hex << std::uppercase << '"';
-    auto sep = "";
+// Flat sets are split into partitions once they reach this size (see mutableSet()).
+const size_t partitionThreshold = 1 << 16;
 
-    for (unsigned char c: encryptedString) {
-        ss << sep << std::setw(2) << std::setfill('0') << (unsigned int) c;
-        sep = " ";
+// Returns contents of a set that can be modified in place. Must be called with slot write-locked.
+// Contents still shared with another set, read-only (e.g. mapped from a file) or of another kind are copied first.
+// Large flat sets are split into partitions instead, so that their copies (snapshots in particular) share everything
+// but the partitions modified since.
+SetStorage& mutableSet(SetSlot& slot){
+    if(slot.kind == SetKind::flat && slot.set->size() >= partitionThreshold
+       && dynamic_cast<const PartitionedSet*>(slot.set.get()) == nullptr){
+        slot.set = std::make_shared<PartitionedSet>(*slot.set);
+    } else if(slot.set.use_count() > 1 || !slot.set->writable() || kindOf(*slot.set) != slot.kind){
+        slot.set = copySet(slot, *slot.set);
+    } else {
+        // Pairs with the release done by the last other owner dropping its reference.
+        std::atomic_thread_fence(std::memory_order_acquire);
     }
+    return *slot.set;
+}
 
-    ss << '"';
-    string ret = ss.str();
-    return ret;
+const PartitionedSet* asPartitioned(const SetStorage& contents){
+    return dynamic_cast<const PartitionedSet*>(&contents);
 }
 
+// Returns contents of a flat set as a partitioned set that can be modified in place, splitting them first if they
+// are not partitioned yet. Must be called with slot write-locked.
+PartitionedSet& mutablePartitioned(SetSlot& slot){
+    if(asPartitioned(*slot.set) == nullptr){
+        slot.set = std::make_shared<PartitionedSet>(*slot.set);
+    }
+    return static_cast<PartitionedSet&>(mutableSet(slot));
 }
 
-unsigned long jnp1::encstrset_new(){
-    if(_debug) err() << "encstrset_new" << "()" << endl;
+// Whether bulk operations may add elements of a large partitioned set to the slot's set, or remove them, on all
+// threads of the worker pool (see PartitionedSet). Not when elements are reported in diagnostics or counted by
+// a Bloom filter one at a time.
+bool parallelBulk(const SetSlot& slot, const SetStorage& elements){
+    return !_debug && slot.kind == SetKind::flat && slot.bloom == nullptr && elements.size() >= partitionThreshold
+        && asPartitioned(elements) != nullptr;
+}
 
-    StringSet s;
-    setCollection()[freeId] = s;
+// Returns maxSlots if all slots are in use. Must be called with registry mutex locked.
+size_t allocateSlot(SlotRegistry& reg){
+    if(!reg.freeSlots.empty()){
+        size_t index = reg.freeSlots.back();
+        reg.freeSlots.pop_back();
+        return index;
+    }
+    if(reg.usedSlots == maxSlots){
+        return maxSlots;
+    }
 
-    if(_debug) err() << "encstrset_new: set #" << freeId << " created" << endl;
-    return freeId++;
+    if(reg.usedSlots == reg.chunks.size() * chunkSize){
+        reg.chunks.emplace_back(new SetSlot[chunkSize]);
+        auto dir = std::make_unique<SlotDirectory>();
+        dir->reserve(reg.chunks.size());
+        for(auto& chunk: reg.chunks){
+            dir->push_back(chunk.get());
+        }
+        reg.directory.store(dir.get(), std::memory_order_release);
+        reg.directories.push_back(std::move(dir));
+    }
+    return reg.usedSlots++;
 }
 
-void jnp1::encstrset_delete(unsigned long id){
-    if(_debug) err() << "encstrset_delete" << "(" << id << ")" << endl;
+// Adds all elements of slot's set to its filter, resizing it for current size. Must be called with slot write-locked.
+void rebuildBloom(SetSlot& slot){
+    BloomFilter& bloom = *slot.bloom;
+    bloom.rebuild(2 * slot.set->size());
+    slot.set->forEach([&](string_view, uint64_t hash){
+        bloom.add(hash);
+    });
+}
+
+// Keeps slot's filter, if there is one, in sync after insertion of element with given hash. Must be called with
+// slot write-locked.
+void bloomInserted(SetSlot& slot, uint64_t hash){
+    if(slot.bloom == nullptr){
+        return;
+    }
+    slot.bloom->add(hash);
+    if(slot.bloom->stale(slot.set->size())){
+        rebuildBloom(slot);
+    }
+}
+
+// Same as bloomInserted(), but after removal.
+void bloomRemoved(SetSlot& slot){
+    if(slot.bloom == nullptr){
+        return;
+    }
+    slot.bloom->removed();
+    if(slot.bloom->stale(slot.set->size())){
+        rebuildBloom(slot);
+    }
+}
 
-    if(setCollection().erase(id) > 0){
-        if(_debug) err() << "encstrset_delete: set #" << id << " deleted" << endl;
+// Looks up and locks sets src_id for reading and dst_id for writing, like lockSet(). Slots are always locked in
+// order of their indexes, so two concurrent operations in opposite directions cannot deadlock. Equal ids lock the
+// slot once, for writing, and both pointers point to it. Different ids pointing to the same slot mean that one of
+// them is stale.
+void lockPair(unsigned long srcId, unsigned long dstId, ReadLock& srcLock, WriteLock& dstLock,
+              SetSlot*& srcSlot, SetSlot*& dstSlot){
+    size_t srcIndex = srcId & indexMask;
+    size_t dstIndex = dstId & indexMask;
+    if(srcIndex == dstIndex){
+        srcSlot = lockSet(srcId, dstLock);
+        if(srcSlot == nullptr){
+            dstSlot = lockSet(dstId, dstLock);
+        } else {
+            dstSlot = srcId == dstId ? srcSlot : nullptr;
+        }
+    } else if(srcIndex < dstIndex){
+        srcSlot = lockSet(srcId, srcLock);
+        dstSlot = lockSet(dstId, dstLock);
     } else {
-        if(_debug) err() << "encstrset_delete: set #" << id << " does not exist" << endl;
+        dstSlot = lockSet(dstId, dstLock);
+        srcSlot = lockSet(srcId, srcLock);
+    }
+}
+
+// Returns new contents for slot holding elements of a that are (if keep) or are not (if !keep) in b. Iterates a,
+// probes b. Interned sets are combined by ids alone.
+std::shared_ptr<SetStorage> filterSet(const SetSlot& slot, const SetStorage& a, const SetStorage& b, bool keep){
+    // Large partitioned sets are filtered partition by partition, on the worker pool. All representations can be
+    // probed concurrently.
+    const PartitionedSet* aParts = asPartitioned(a);
+    if(slot.kind == SetKind::flat && aParts != nullptr && a.size() >= partitionThreshold){
+        auto result = std::make_shared<PartitionedSet>();
+        result->assignFiltered(*aParts, [&](string_view s, uint64_t hash){
+            return b.contains(s, hash) == keep;
+        });
+        return result;
+    }
+
+    std::shared_ptr<SetStorage> result = emptySet(slot);
+    result->reserve(keep ? std::min(a.size(), b.size()) : a.size());
+
+    const InternedSet* aIds = asInterned(a);
+    const InternedSet* bIds = asInterned(b);
+    InternedSet* resultIds = asInterned(*result);
+    if(aIds != nullptr && bIds != nullptr && resultIds != nullptr){
+        aIds->forEachId([&](uint32_t element){
+            if(bIds->containsId(element) == keep){
+                resultIds->insertId(element);
+            }
+        });
+        return result;
     }
 
+    a.forEach([&](string_view s, uint64_t hash){
+        if(b.contains(s, hash) == keep){
+            result->insert(s, hash);
+        }
+    });
+    return result;
 }
 
-size_t jnp1::encstrset_size(unsigned long id){
-    if(_debug) err() << "encstrset_size" << "(" << id << ")" << endl;
+// Replaces contents of a write-locked slot.
+void replaceSet(SetSlot& slot, std::shared_ptr<SetStorage> contents){
+    slot.set = std::move(contents);
+    if(slot.bloom != nullptr){
+        rebuildBloom(slot);
+    }
+}
 
-    auto setIt = setCollection().find(id);
-    if(setIt == setCollection().end()){
-        if(_debug) err() << "encstrset_size: set #" << id << " does not exist" << endl;
-        return 0;
+// Whether contents dropped by encstrset_clear() and encstrset_delete() are freed on the reclaimer thread.
+std::atomic<bool>& deferredReclaim(){
+    static std::atomic<bool> enabled{false};
+    return enabled;
+}
+
+// Drops contents taken out of a slot. Must be called with no slot locked, so that freeing large contents never
+// blocks other users of the set. Contents this is the last reference to are handed to the reclaimer thread
+// if deferred reclamation is on.
+void dropContents(std::shared_ptr<SetStorage> contents){
+    if(contents != nullptr && contents.use_count() == 1 && deferredReclaim().load(std::memory_order_relaxed)){
+        Reclaimer::instance().retire(std::move(contents));
     }
+}
 
-    size_t size = setIt->second.size();
-    if(_debug) err() << "encstrset_size: set #" << id << " contains " << size << " element(s)" << endl;
-    return size;
+// Sets at least this large are cleared by replacing their contents, which are then dropped like those of a deleted
+// set, instead of in place.
+const size_t bulkClearThreshold = 1 << 12;
+
+// Creates set of given kind with given contents and returns its id, or ENCSTRSET_NO_SET if there are too many sets.
+unsigned long createSet(std::shared_ptr<SetStorage> contents, SetKind kind, bool frozen){
+    SlotRegistry& reg = registry();
+    std::lock_guard<std::mutex> registryLock(reg.mutex);
+    size_t index = allocateSlot(reg);
+    if(index == maxSlots){
+        return ENCSTRSET_NO_SET;
+    }
+    SetSlot* slot = findSlot(index);
+
+    WriteLock lock(slot->mutex);
+    slot->alive = true;
+    slot->kind = kind;
+    slot->frozen = frozen;
+    slot->set = std::move(contents);
+    return makeId(index, slot->generation);
 }
 
-bool jnp1::encstrset_insert(unsigned long id, const char* value, const char* key){
-    if(_debug) err() << "encstrset_insert" << "(" << id << ", " << &value << ", " << &key << ")" << endl;
+// Set files are laid out so that a mapped file can be probed in place:
+//     header, control bytes, padding to 8 bytes, slots, arena
+// which is exactly a FlatTable (see flatset.h) preceded by a header. Integers are stored in native byte order,
+// files written on a machine with different order are rejected thanks to byteOrder field. Arena is compacted on save.
+struct SetFileHeader{
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t arenaSize;
+    uint64_t ctrlOffset;
+    uint64_t slotsOffset;
+    uint64_t arenaOffset;
+};
 
-    if(value == nullptr){
-        if(_debug) err() << "encstrset_insert: invalid value (NULL)" << endl;
+const char setFileMagic[8] = {'E', 'N', 'C', 'S', 'T', 'R', 'S', 'T'};
+const uint32_t setFileByteOrder = 0x01020304;
+const uint32_t setFileVersion = 1;
+
+uint64_t alignUp(uint64_t n, uint64_t alignment){
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+// Writes table of contents to path. Table is written to a temporary file first, which then replaces path,
+// so an existing file is never left half-written.
+bool writeSetFile(const StringSet& contents, const string& path){
+    FlatTable t = contents.table();
+
+    SetFileHeader header{};
+    std::memcpy(header.magic, setFileMagic, sizeof(setFileMagic));
+    header.byteOrder = setFileByteOrder;
+    header.version = setFileVersion;
+    header.count = contents.size();
+    header.capacity = t.capacity;
+    header.ctrlOffset = sizeof(SetFileHeader);
+    header.slotsOffset = alignUp(header.ctrlOffset + t.capacity, alignof(FlatTable::Slot));
+    header.arenaOffset = header.slotsOffset + t.capacity * sizeof(FlatTable::Slot);
+    header.arenaSize = 0;
+    t.forEach([&](string_view s, uint64_t){
+        header.arenaSize += FlatTable::recordSize(s.size());
+    });
+
+    string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write((const char*) &header, sizeof(header));
+    out.write((const char*) t.ctrl, t.capacity);
+    const char padding[alignof(FlatTable::Slot)] = {};
+    out.write(padding, header.slotsOffset - header.ctrlOffset - t.capacity);
+
+    // Offsets change because garbage left in the arena by erased elements is skipped.
+    uint64_t offset = 0;
+    for(size_t i = 0; i < t.capacity; i++){
+        FlatTable::Slot slot{0, 0};
+        if(FlatTable::isFull(t.ctrl[i])){
+            slot = FlatTable::Slot{t.slots[i].hash, offset};
+            offset += FlatTable::recordSize(t.lengthAt(t.slots[i].offset));
+        }
+        out.write((const char*) &slot, sizeof(slot));
+    }
+    for(size_t i = 0; i < t.capacity; i++){
+        if(FlatTable::isFull(t.ctrl[i])){
+            out.write(t.arena + t.slots[i].offset, FlatTable::recordSize(t.lengthAt(t.slots[i].offset)));
+        }
+    }
+
+    out.close();
+    if(!out || std::rename(tmpPath.c_str(), path.c_str()) != 0){
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Whether the table of a mapped file can be probed and iterated without reading past its arena: control bytes
+// are all valid, count of them full, with enough left empty to end every probe, and all records of full slots fit
+// in the arena.
+bool validTable(const FlatTable& t, uint64_t count, uint64_t arenaSize){
+    uint64_t full = 0, empty = 0;
+    for(size_t i = 0; i < t.capacity; i++){
+        uint8_t c = t.ctrl[i];
+        if(FlatTable::isFull(c)){
+            uint64_t offset = t.slots[i].offset;
+            if(offset > arenaSize || arenaSize - offset < sizeof(uint32_t)
+               || t.lengthAt(offset) > arenaSize - offset - sizeof(uint32_t)){
+                return false;
+            }
+            full++;
+        } else if(c == FlatTable::emptyCtrl){
+            empty++;
+        } else if(c != FlatTable::deletedCtrl){
+            return false;
+        }
+    }
+    return full == count && t.capacity - empty <= FlatTable::maxLoad(t.capacity);
+}
+
+// Maps file written by writeSetFile() and returns a read-only view of it or nullptr if the file cannot be used.
+// Control bytes, slots and record lengths are checked before the view is returned, so a truncated or corrupted file
+// is rejected instead of making probes read past the mapping; the rest of the arena is paged in as it is probed.
+std::shared_ptr<SetStorage> mapSetFile(const char* path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        return nullptr;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SetFileHeader)){
+        close(fd);
+        return nullptr;
+    }
+    size_t length = st.st_size;
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED){
+        return nullptr;
+    }
+    std::shared_ptr<const void> memory(addr, [length](const void* p){ munmap(const_cast<void*>(p), length); });
+
+    const char* base = (const char*) addr;
+    SetFileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    // Capacity is bounded by the length of the file first, so that no offset computed from it can overflow.
+    bool valid = std::memcmp(header.magic, setFileMagic, sizeof(setFileMagic)) == 0
+        && header.byteOrder == setFileByteOrder
+        && header.version == setFileVersion
+        && (header.capacity & (header.capacity - 1)) == 0
+        && header.capacity % FlatTable::groupWidth == 0
+        && header.capacity <= length / (1 + sizeof(FlatTable::Slot))
+        && header.count <= FlatTable::maxLoad(header.capacity)
+        && header.ctrlOffset == sizeof(SetFileHeader)
+        && header.slotsOffset == alignUp(header.ctrlOffset + header.capacity, alignof(FlatTable::Slot))
+        && header.arenaOffset == header.slotsOffset + header.capacity * sizeof(FlatTable::Slot)
+        && header.arenaOffset <= length
+        && header.arenaSize == length - header.arenaOffset;
+    if(!valid){
+        return nullptr;
+    }
+
+    FlatTable t{(const uint8_t*) base + header.ctrlOffset, (const FlatTable::Slot*) (base + header.slotsOffset),
+        base + header.arenaOffset, header.capacity};
+    if(!validTable(t, header.count, header.arenaSize)){
+        return nullptr;
+    }
+    return std::make_shared<FlatView>(t, header.count, header.arenaSize, std::move(memory));
+}
+
+// Buffer for the cyphertext of the current call. Reused, so encryption does not allocate once it has grown.
+string& cypherBuffer(){
+    thread_local string buffer;
+    return buffer;
+}
+
+// Expands key (empty means no encryption) into a key object reused by the calling thread.
+const XorKey& scratchKey(string_view key){
+    thread_local XorKey scratch;
+    scratch.assign(key);
+    return scratch;
+}
+
+// View of C string, empty for NULL.
+string_view view(const char* s){
+    return s == nullptr ? string_view() : string_view(s);
+}
+
+// Implementations of encstrset_insert(), encstrset_remove() and encstrset_test() shared with their variants,
+// whose name fn is used in diagnostics. Value is encrypted before locking the set, so the lock is held only
+// while the set is accessed.
+
+bool insertValue(const char* fn, unsigned long id, string_view value, const XorKey& key){
+    CallTimer timer(jnp1::ENCSTRSET_FN_INSERT);
+
+    string& encrypted = cypherBuffer();
+    key.encrypt(value, encrypted);
+    uint64_t hash = StringSet::hash(encrypted);
+
+    WriteLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, fn, ": set #", id, " does not exist");
+        return false;
+    }
+
+    if(slot->frozen){
+        if(_debug) logLine(LogLevel::error, fn, ": set #", id, " is frozen");
         return false;
     }
 
-    auto setIt = setCollection().find(id);
-    if(setIt == setCollection().end()){
-        if(_debug) err() << "encstrset_insert: set #" << id << " does not exist" << endl;
+    if(slot->set->contains(encrypted, hash)){
+        if(_debug) logLine(LogLevel::info, fn, ": set #", id, ", cypher ", cypher(encrypted), " was already present");
         return false;
     }
 
-    StringSet& set = setIt->second;
-    string encrypted = xorEncrypt(value, key);
+    mutableSet(*slot).insert(encrypted, hash);
+    bloomInserted(*slot, hash);
+    if(_debug) logLine(LogLevel::info, fn, ": set #", id, ", cypher ", cypher(encrypted), " inserted");
+    timer.hit();
+    return true;
+}
+
+bool removeValue(const char* fn, unsigned long id, string_view value, const XorKey& key){
+    CallTimer timer(jnp1::ENCSTRSET_FN_REMOVE);
 
-    if(std::get<1>(set.insert(encrypted))){
-        if(_debug) err() << "encstrset_insert: set #" << id << ", cypher " << printCypher(encrypted) << " inserted" << endl;
+    string& encrypted = cypherBuffer();
+    key.encrypt(value, encrypted);
+    uint64_t hash = StringSet::hash(encrypted);
+
+    WriteLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, fn, ": set #", id, " does not exist");
+        return false;
+    }
+
+    if(slot->frozen){
+        if(_debug) logLine(LogLevel::error, fn, ": set #", id, " is frozen");
+        return false;
+    }
+
+    if(!slot->set->contains(encrypted, hash)){
+        if(_debug) logLine(LogLevel::info, fn, ": set #", id, ", cypher ", cypher(encrypted), " was not present");
+        return false;
+    }
+
+    mutableSet(*slot).erase(encrypted, hash);
+    bloomRemoved(*slot);
+    if(_debug) logLine(LogLevel::info, fn, ": set #", id, ", cypher ", cypher(encrypted), " removed");
+    timer.hit();
+    return true;
+}
+
+bool testValue(const char* fn, unsigned long id, string_view value, const XorKey& key){
+    CallTimer timer(jnp1::ENCSTRSET_FN_TEST);
+
+    string& encrypted = cypherBuffer();
+    key.encrypt(value, encrypted);
+    uint64_t hash = StringSet::hash(encrypted);
+
+    ReadLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, fn, ": set #", id, " does not exist");
+        return false;
+    }
+
+    bool present;
+    const BloomFilter* bloom = slot->bloom.get();
+    if(bloom == nullptr){
+        present = slot->set->contains(encrypted, hash);
+    } else {
+        bloom->queries.fetch_add(1, std::memory_order_relaxed);
+        if(!bloom->mayContain(hash)){
+            bloom->rejected.fetch_add(1, std::memory_order_relaxed);
+            present = false;
+        } else {
+            present = slot->set->contains(encrypted, hash);
+            if(!present){
+                bloom->falsePositives.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    if(present){
+        if(_debug) logLine(LogLevel::info, fn, ": set #", id, ", cypher ", cypher(encrypted), " is present");
+        timer.hit();
         return true;
     } else {
-        if(_debug) err() << "encstrset_insert: set #" << id << ", cypher " << printCypher(encrypted) << " was already present" << endl;
+        if(_debug) logLine(LogLevel::info, fn, ": set #", id, ", cypher ", cypher(encrypted), " is not present");
         return false;
     }
 }
 
-bool jnp1::encstrset_remove(unsigned long id, const char* value, const char* key){
-    if(_debug) err() << "encstrset_remove" << "(" << id << ", " << &value << ", " << &key << ")" << endl;
+// Adds all elements of set src_id to set dst_id. Implements encstrset_copy() and encstrset_union_into(), whose name
+// is used in diagnostics. Returns false if the sets could not be combined.
+bool unionInto(const char* fn, unsigned long src_id, unsigned long dst_id){
+    ReadLock srcLock;
+    WriteLock dstLock;
+    SetSlot* srcSlot;
+    SetSlot* dstSlot;
+    lockPair(src_id, dst_id, srcLock, dstLock, srcSlot, dstSlot);
 
-    if(value == nullptr){
-        if(_debug) err() << "encstrset_remove: invalid value (NULL)" << endl;
+    if(srcSlot == nullptr){
+        if(_debug) logLine(LogLevel::error, fn, ": set #", src_id, " does not exist");
         return false;
     }
 
-    auto setIt = setCollection().find(id);
-    if(setIt == setCollection().end()){
-        if(_debug) err() << "encstrset_remove: set #" << id << " does not exist" << endl;
+    if(dstSlot == nullptr){
+        if(_debug) logLine(LogLevel::error, fn, ": set #", dst_id, " does not exist");
         return false;
     }
 
-    StringSet& set = setIt->second;
-    string encrypted = xorEncrypt(value, key);
+    if(dstSlot->frozen){
+        if(_debug) logLine(LogLevel::error, fn, ": set #", dst_id, " is frozen");
+        return false;
+    }
 
-    if(set.erase(encrypted) > 0){
-        if(_debug) err() << "encstrset_remove: set #" << id << ", cypher " << printCypher(encrypted) << " removed" << endl;
+    const SetStorage& srcSet = *srcSlot->set;
+    if(srcSlot == dstSlot){
+        if(_debug){
+            srcSet.forEach([&](string_view s, uint64_t){
+                logLine(LogLevel::info, fn, ": copied cypher ", cypher(s), " was already present in set #", dst_id);
+            });
+        }
         return true;
-    } else {
-        if(_debug) err() << "encstrset_remove: set #" << id << ", cypher " << printCypher(encrypted) << " was not present" << endl;
+    }
+
+    // Copying into an empty set of the source's kind just shares contents of the source. They are copied only when
+    // one of the sets is modified. A set of another kind gets them converted right away, so that its representation
+    // (the order of an ordered set in particular) holds from the start.
+    if(dstSlot->set->empty()){
+        if(kindOf(srcSet) == dstSlot->kind){
+            dstSlot->set = srcSlot->set;
+        } else {
+            dstSlot->set = copySet(*dstSlot, srcSet);
+        }
+        if(dstSlot->bloom != nullptr){
+            rebuildBloom(*dstSlot);
+        }
+        if(_debug){
+            srcSet.forEach([&](string_view s, uint64_t){
+                logLine(LogLevel::info, fn, ": cypher ", cypher(s), " copied from set #", src_id, " to set #", dst_id);
+            });
+        }
+        return true;
+    }
+
+    if(parallelBulk(*dstSlot, srcSet)){
+        mutablePartitioned(*dstSlot).insertAll(*asPartitioned(srcSet));
+        return true;
+    }
+
+    SetStorage& dstSet = mutableSet(*dstSlot);
+    dstSet.reserve(dstSet.size() + srcSet.size());
+    auto copied = [&](string_view s, uint64_t hash, bool inserted){
+        if(inserted){
+            bloomInserted(*dstSlot, hash);
+            if(_debug) logLine(LogLevel::info, fn, ": cypher ", cypher(s), " copied from set #", src_id, " to set #", dst_id);
+        } else {
+            if(_debug) logLine(LogLevel::info, fn, ": copied cypher ", cypher(s), " was already present in set #", dst_id);
+        }
+    };
+
+    // Interned sets are merged by ids, cyphers are looked at only to report them.
+    const InternedSet* srcIds = asInterned(srcSet);
+    InternedSet* dstIds = asInterned(dstSet);
+    if(srcIds != nullptr && dstIds != nullptr){
+        const InternPool& pool = InternPool::instance();
+        srcIds->forEachId([&](uint32_t element){
+            bool inserted = dstIds->insertId(element);
+            if(_debug || (inserted && dstSlot->bloom != nullptr)){
+                copied(pool.bytes(element), pool.hash(element), inserted);
+            }
+        });
+        return true;
+    }
+
+    // Hashes cached in the source are reused, so no cypher is hashed again.
+    srcSet.forEach([&](string_view s, uint64_t hash){
+        copied(s, hash, dstSet.insert(s, hash));
+    });
+    return true;
+}
+}
+
+unsigned long jnp1::encstrset_new(){
+    if(_debug) logCall("encstrset_new");
+
+    CallTimer timer(jnp1::ENCSTRSET_FN_NEW);
+
+    unsigned long id = createSet(std::make_shared<StringSet>(), SetKind::flat, false);
+
+    if(id == ENCSTRSET_NO_SET){
+        if(_debug) logLine(LogLevel::error, "encstrset_new: too many sets");
+        return id;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_new: set #", id, " created");
+    timer.hit();
+    return id;
+}
+
+unsigned long jnp1::encstrset_new_interned(){
+    if(_debug) logCall("encstrset_new_interned");
+
+    CallTimer timer(jnp1::ENCSTRSET_FN_NEW);
+
+    unsigned long id = createSet(std::make_shared<InternedSet>(), SetKind::interned, false);
+
+    if(id == ENCSTRSET_NO_SET){
+        if(_debug) logLine(LogLevel::error, "encstrset_new_interned: too many sets");
+        return id;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_new_interned: set #", id, " created");
+    timer.hit();
+    return id;
+}
+
+unsigned long jnp1::encstrset_new_ordered(){
+    if(_debug) logCall("encstrset_new_ordered");
+
+    CallTimer timer(jnp1::ENCSTRSET_FN_NEW);
+
+    unsigned long id = createSet(std::make_shared<OrderedSet>(), SetKind::ordered, false);
+
+    if(id == ENCSTRSET_NO_SET){
+        if(_debug) logLine(LogLevel::error, "encstrset_new_ordered: too many sets");
+        return id;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_new_ordered: set #", id, " created");
+    timer.hit();
+    return id;
+}
+
+unsigned long jnp1::encstrset_new_with_capacity(size_t n){
+    if(_debug) logCall("encstrset_new_with_capacity", n);
+
+    CallTimer timer(jnp1::ENCSTRSET_FN_NEW);
+
+    auto contents = std::make_shared<StringSet>();
+    contents->reserve(n);
+    unsigned long id = createSet(std::move(contents), SetKind::flat, false);
+
+    if(id == ENCSTRSET_NO_SET){
+        if(_debug) logLine(LogLevel::error, "encstrset_new_with_capacity: too many sets");
+        return id;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_new_with_capacity: set #", id, " created");
+    timer.hit();
+    return id;
+}
+
+bool jnp1::encstrset_reserve(unsigned long id, size_t n){
+    if(_debug) logCall("encstrset_reserve", id, n);
+
+    WriteLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_reserve: set #", id, " does not exist");
+        return false;
+    }
+
+    if(slot->frozen){
+        if(_debug) logLine(LogLevel::error, "encstrset_reserve: set #", id, " is frozen");
+        return false;
+    }
+
+    mutableSet(*slot).reserve(n);
+    if(_debug) logLine(LogLevel::info, "encstrset_reserve: set #", id, " has room for ", n, " element(s)");
+    return true;
+}
+
+void jnp1::encstrset_delete(unsigned long id){
+    if(_debug) logCall("encstrset_delete", id);
+
+    CallTimer timer(jnp1::ENCSTRSET_FN_DELETE);
+
+    SetSlot* slot = findSlot(id);
+    WriteLock lock;
+    if(slot != nullptr){
+        lock = WriteLock(slot->mutex);
+    }
+    if(slot == nullptr || !holdsSet(*slot, id)){
+        if(_debug) logLine(LogLevel::error, "encstrset_delete: set #", id, " does not exist");
+        return;
+    }
+
+    std::shared_ptr<SetStorage> contents = std::move(slot->set);
+    slot->bloom.reset();
+    slot->frozen = false;
+    slot->kind = SetKind::flat;
+    slot->alive = false;
+    slot->generation = (slot->generation + 1) & (ULONG_MAX >> indexBits);
+    lock.unlock();
+    dropContents(std::move(contents));
+
+    // Slot is released only after it is unlocked, so the registry mutex is never taken while holding a slot lock.
+    SlotRegistry& reg = registry();
+    {
+        std::lock_guard<std::mutex> registryLock(reg.mutex);
+        reg.freeSlots.push_back(id & indexMask);
+    }
+
+    if(_debug) logLine(LogLevel::info, "encstrset_delete: set #", id, " deleted");
+    timer.hit();
+}
+
+size_t jnp1::encstrset_size(unsigned long id){
+    if(_debug) logCall("encstrset_size", id);
+
+    CallTimer timer(jnp1::ENCSTRSET_FN_SIZE);
+
+    ReadLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_size: set #", id, " does not exist");
+        return 0;
+    }
+
+    size_t size = slot->set->size();
+    if(_debug) logLine(LogLevel::info, "encstrset_size: set #", id, " contains ", size, " element(s)");
+    timer.hit();
+    return size;
+}
+
+bool jnp1::encstrset_insert(unsigned long id, const char* value, const char* key){
+    if(_debug) logCall("encstrset_insert", id, quoted(value), quoted(key));
+
+    if(value == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_insert: invalid value (NULL)");
         return false;
     }
+    return insertValue("encstrset_insert", id, value, scratchKey(view(key)));
+}
+
+bool jnp1::encstrset_remove(unsigned long id, const char* value, const char* key){
+    if(_debug) logCall("encstrset_remove", id, quoted(value), quoted(key));
+
+    if(value == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_remove: invalid value (NULL)");
+        return false;
+    }
+    return removeValue("encstrset_remove", id, value, scratchKey(view(key)));
 }
 
 bool jnp1::encstrset_test(unsigned long id, const char* value, const char* key){
-    if(_debug) err() << "encstrset_test" << "(" << id << ", " << &value << ", " << &key << ")" << endl;
+    if(_debug) logCall("encstrset_test", id, quoted(value), quoted(key));
 
     if(value == nullptr){
-        if(_debug) err() << "encstrset_test: invalid value (NULL)" << endl;
+        if(_debug) logLine(LogLevel::error, "encstrset_test: invalid value (NULL)");
         return false;
     }
+    return testValue("encstrset_test", id, value, scratchKey(view(key)));
+}
+
+bool jnp1::encstrset_insert_n(unsigned long id, const char* value, size_t value_len, const char* key, size_t key_len){
+    if(_debug) logCall("encstrset_insert_n", id, quoted(value, value_len), value_len, quoted(key, key_len), key_len);
 
-    auto setIt = setCollection().find(id);
-    if(setIt == setCollection().end()){
-        if(_debug) err() << "encstrset_test: set #" << id << " does not exist" << endl;
+    if(value == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_insert_n: invalid value (NULL)");
         return false;
     }
+    string_view keyBytes = key == nullptr ? string_view() : string_view(key, key_len);
+    return insertValue("encstrset_insert_n", id, string_view(value, value_len), scratchKey(keyBytes));
+}
 
-    StringSet& set = setIt->second;
-    string encrypted = xorEncrypt(value, key);
+bool jnp1::encstrset_remove_n(unsigned long id, const char* value, size_t value_len, const char* key, size_t key_len){
+    if(_debug) logCall("encstrset_remove_n", id, quoted(value, value_len), value_len, quoted(key, key_len), key_len);
 
-    if(set.find(encrypted) != set.end()){
-        if(_debug) err() << "encstrset_test: set #" << id << ", cypher " << printCypher(encrypted) << " is present" << endl;
-        return true;
-    } else {
-        if(_debug) err() << "encstrset_test: set #" << id << ", cypher " << printCypher(encrypted) << " is not present" << endl;
+    if(value == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_remove_n: invalid value (NULL)");
         return false;
     }
+    string_view keyBytes = key == nullptr ? string_view() : string_view(key, key_len);
+    return removeValue("encstrset_remove_n", id, string_view(value, value_len), scratchKey(keyBytes));
+}
+
+bool jnp1::encstrset_test_n(unsigned long id, const char* value, size_t value_len, const char* key, size_t key_len){
+    if(_debug) logCall("encstrset_test_n", id, quoted(value, value_len), value_len, quoted(key, key_len), key_len);
+
+    if(value == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_test_n: invalid value (NULL)");
+        return false;
+    }
+    string_view keyBytes = key == nullptr ? string_view() : string_view(key, key_len);
+    return testValue("encstrset_test_n", id, string_view(value, value_len), scratchKey(keyBytes));
 }
 
 void jnp1::encstrset_clear(unsigned long id){
-    if(_debug) err() << "encstrset_clear" << "(" << id << ")" << endl;
+    if(_debug) logCall("encstrset_clear", id);
 
-    auto setIt = setCollection().find(id);
-    if(setIt == setCollection().end()){
-        if(_debug) err() << "encstrset_clear: set #" << id << " does not exist" << endl;
+    CallTimer timer(jnp1::ENCSTRSET_FN_CLEAR);
+
+    WriteLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_clear: set #", id, " does not exist");
         return;
     }
 
-    setIt->second.clear();
-    if(_debug) err() << "encstrset_clear: set #" << id << " cleared" << endl;
+    if(slot->frozen){
+        if(_debug) logLine(LogLevel::error, "encstrset_clear: set #", id, " is frozen");
+        return;
+    }
+
+    // Contents shared with other sets are left to them instead of being copied just to be cleared. Large ones
+    // are replaced as well, so that they are freed after unlocking the set.
+    std::shared_ptr<SetStorage> contents;
+    if(slot->set.use_count() > 1 || !slot->set->writable() || slot->set->size() >= bulkClearThreshold){
+        contents = std::exchange(slot->set, emptySet(*slot));
+    } else {
+        mutableSet(*slot).clear();
+    }
+    if(slot->bloom != nullptr){
+        slot->bloom->clear();
+    }
+    lock.unlock();
+    dropContents(std::move(contents));
+
+    if(_debug) logLine(LogLevel::info, "encstrset_clear: set #", id, " cleared");
+    timer.hit();
 }
 
 void jnp1::encstrset_copy(unsigned long src_id, unsigned long dst_id){
-    if(_debug) err() << "encstrset_copy" << "(" << src_id << ", " << dst_id << ")" << endl;
+    if(_debug) logCall("encstrset_copy", src_id, dst_id);
+
+    CallTimer timer(jnp1::ENCSTRSET_FN_COPY);
+    if(unionInto("encstrset_copy", src_id, dst_id)){
+        timer.hit();
+    }
+}
+
+void jnp1::encstrset_union_into(unsigned long src_id, unsigned long dst_id){
+    if(_debug) logCall("encstrset_union_into", src_id, dst_id);
 
-    auto srcSetIt = setCollection().find(src_id);
-    if(srcSetIt == setCollection().end()){
-        if(_debug) err() << "encstrset_copy: set #" << src_id << " does not exist" << endl;
+    CallTimer timer(jnp1::ENCSTRSET_FN_UNION_INTO);
+    if(unionInto("encstrset_union_into", src_id, dst_id)){
+        timer.hit();
+    }
+}
+
+void jnp1::encstrset_intersect(unsigned long src_id, unsigned long dst_id){
+    if(_debug) logCall("encstrset_intersect", src_id, dst_id);
+
+    CallTimer timer(jnp1::ENCSTRSET_FN_INTERSECT);
+
+    ReadLock srcLock;
+    WriteLock dstLock;
+    SetSlot* srcSlot;
+    SetSlot* dstSlot;
+    lockPair(src_id, dst_id, srcLock, dstLock, srcSlot, dstSlot);
+
+    if(srcSlot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_intersect: set #", src_id, " does not exist");
         return;
     }
 
-    auto dstSetIt = setCollection().find(dst_id);
-    if(dstSetIt == setCollection().end()){
-        if(_debug) err() << "encstrset_copy: set #" << dst_id << " does not exist" << endl;
+    if(dstSlot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_intersect: set #", dst_id, " does not exist");
         return;
     }
 
-    StringSet& srcSet = srcSetIt->second;
-    StringSet& dstSet = dstSetIt->second;
-    for(const string& s: srcSet){
-        if(std::get<1>(dstSet.insert(s))){
-            if(_debug) err() << "encstrset_copy: cypher " << printCypher(s) << " copied from set #" << src_id << " to set #" << dst_id << endl;
+    if(dstSlot->frozen){
+        if(_debug) logLine(LogLevel::error, "encstrset_intersect: set #", dst_id, " is frozen");
+        return;
+    }
+
+    // Result is built by iterating the smaller set and probing the larger one.
+    const SetStorage& srcSet = *srcSlot->set;
+    const SetStorage& dstSet = *dstSlot->set;
+    if(srcSlot != dstSlot && srcSlot->set != dstSlot->set){
+        if(srcSet.size() < dstSet.size()){
+            replaceSet(*dstSlot, filterSet(*dstSlot, srcSet, dstSet, true));
         } else {
-            if(_debug) err() << "encstrset_copy: copied cypher " << printCypher(s) << " was already present in set #" << dst_id << endl;
+            replaceSet(*dstSlot, filterSet(*dstSlot, dstSet, srcSet, true));
+        }
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_intersect: set #", dst_id, " intersected with set #", src_id,
+        ", ", dstSlot->set->size(), " element(s) left");
+    timer.hit();
+}
+
+void jnp1::encstrset_difference(unsigned long src_id, unsigned long dst_id){
+    if(_debug) logCall("encstrset_difference", src_id, dst_id);
+
+    CallTimer timer(jnp1::ENCSTRSET_FN_DIFFERENCE);
+
+    ReadLock srcLock;
+    WriteLock dstLock;
+    SetSlot* srcSlot;
+    SetSlot* dstSlot;
+    lockPair(src_id, dst_id, srcLock, dstLock, srcSlot, dstSlot);
+
+    if(srcSlot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_difference: set #", src_id, " does not exist");
+        return;
+    }
+
+    if(dstSlot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_difference: set #", dst_id, " does not exist");
+        return;
+    }
+
+    if(dstSlot->frozen){
+        if(_debug) logLine(LogLevel::error, "encstrset_difference: set #", dst_id, " is frozen");
+        return;
+    }
+
+    if(srcSlot == dstSlot || srcSlot->set == dstSlot->set){
+        replaceSet(*dstSlot, emptySet(*dstSlot));
+    } else if(srcSlot->set->size() < dstSlot->set->size()){
+        // Few elements to remove: erase them one by one. Source is left intact even if the sets shared contents
+        // before, since mutableSet() gives destination its own copy.
+        std::shared_ptr<SetStorage> src = srcSlot->set;
+        if(parallelBulk(*dstSlot, *src)){
+            mutablePartitioned(*dstSlot).eraseAll(*asPartitioned(*src));
+        } else {
+            SetStorage& dstSet = mutableSet(*dstSlot);
+            const InternedSet* srcIds = asInterned(*src);
+            InternedSet* dstIds = asInterned(dstSet);
+            if(srcIds != nullptr && dstIds != nullptr){
+                srcIds->forEachId([&](uint32_t element){
+                    if(dstIds->eraseId(element)){
+                        bloomRemoved(*dstSlot);
+                    }
+                });
+            } else {
+                src->forEach([&](string_view s, uint64_t hash){
+                    if(dstSet.erase(s, hash)){
+                        bloomRemoved(*dstSlot);
+                    }
+                });
+            }
+        }
+    } else {
+        replaceSet(*dstSlot, filterSet(*dstSlot, *dstSlot->set, *srcSlot->set, false));
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_difference: set #", src_id, " subtracted from set #", dst_id,
+        ", ", dstSlot->set->size(), " element(s) left");
+    timer.hit();
+}
+
+bool jnp1::encstrset_save(unsigned long id, const char* path){
+    if(_debug) logCall("encstrset_save", id, quoted(path));
+
+    if(path == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_save: invalid path (NULL)");
+        return false;
+    }
+
+    // Shared contents are never modified (see mutableSet()), so the file is written from a reference taken under
+    // the lock, without holding it.
+    std::shared_ptr<SetStorage> shared;
+    {
+        ReadLock lock;
+        SetSlot* slot = lockSet(id, lock);
+        if(slot == nullptr){
+            if(_debug) logLine(LogLevel::error, "encstrset_save: set #", id, " does not exist");
+            return false;
+        }
+        shared = slot->set;
+    }
+
+    // Files always hold a flat table, other representations are converted.
+    const StringSet* contents = dynamic_cast<const StringSet*>(shared.get());
+    StringSet copy;
+    if(contents == nullptr){
+        copy.reserve(shared->size());
+        shared->forEach([&](string_view s, uint64_t hash){
+            copy.insert(s, hash);
+        });
+        contents = &copy;
+    }
+
+    bool written = writeSetFile(*contents, path);
+    dropContents(std::move(shared));
+    if(!written){
+        if(_debug) logLine(LogLevel::error, "encstrset_save: set #", id, " could not be written to ", quoted(path));
+        return false;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_save: set #", id, " saved to ", quoted(path));
+    return true;
+}
+
+unsigned long jnp1::encstrset_load(const char* path){
+    if(_debug) logCall("encstrset_load", quoted(path));
+
+    std::shared_ptr<SetStorage> contents = path == nullptr ? nullptr : mapSetFile(path);
+    if(contents == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_load: ", quoted(path), " is not a valid set file");
+        return ENCSTRSET_NO_SET;
+    }
+
+    unsigned long id = createSet(std::move(contents), SetKind::flat, false);
+    if(id == ENCSTRSET_NO_SET){
+        if(_debug) logLine(LogLevel::error, "encstrset_load: too many sets");
+        return id;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_load: set #", id, " loaded from ", quoted(path));
+    return id;
+}
+
+bool jnp1::encstrset_bloom_enable(unsigned long id, size_t bits_per_element){
+    if(_debug) logCall("encstrset_bloom_enable", id, bits_per_element);
+
+    WriteLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_bloom_enable: set #", id, " does not exist");
+        return false;
+    }
+
+    if(bits_per_element == 0){
+        bits_per_element = BloomFilter::defaultBitsPerElement;
+    }
+    slot->bloom = std::make_unique<BloomFilter>(bits_per_element, 2 * slot->set->size());
+    rebuildBloom(*slot);
+    if(_debug) logLine(LogLevel::info, "encstrset_bloom_enable: set #", id, " filtered with ", slot->bloom->bits(), " bits");
+    return true;
+}
+
+void jnp1::encstrset_bloom_disable(unsigned long id){
+    if(_debug) logCall("encstrset_bloom_disable", id);
+
+    WriteLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_bloom_disable: set #", id, " does not exist");
+        return;
+    }
+
+    slot->bloom.reset();
+    if(_debug) logLine(LogLevel::info, "encstrset_bloom_disable: set #", id, " is not filtered");
+}
+
+bool jnp1::encstrset_bloom_stats(unsigned long id, encstrset_bloom_info* stats){
+    if(_debug) logCall("encstrset_bloom_stats", id);
+
+    ReadLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_bloom_stats: set #", id, " does not exist");
+        return false;
+    }
+    if(slot->bloom == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_bloom_stats: set #", id, " is not filtered");
+        return false;
+    }
+
+    const BloomFilter& bloom = *slot->bloom;
+    if(stats != nullptr){
+        stats->bits = bloom.bits();
+        stats->queries = bloom.queries.load(std::memory_order_relaxed);
+        stats->rejected = bloom.rejected.load(std::memory_order_relaxed);
+        stats->false_positives = bloom.falsePositives.load(std::memory_order_relaxed);
+        stats->rebuilds = bloom.rebuilds;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_bloom_stats: set #", id, ", ", bloom.rejected.load(), " of ",
+        bloom.queries.load(), " test(s) rejected, ", bloom.falsePositives.load(), " false positive(s)");
+    return true;
+}
+
+bool jnp1::encstrset_freeze(unsigned long id){
+    if(_debug) logCall("encstrset_freeze", id);
+
+    WriteLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_freeze: set #", id, " does not exist");
+        return false;
+    }
+
+    // Ordered sets keep their representation, the only one that can be scanned in order. It is not modified while
+    // the set is frozen anyway.
+    if(!slot->frozen && slot->kind != SetKind::ordered){
+        try{
+            slot->set = std::make_shared<FrozenSet>(*slot->set);
+        } catch(const std::exception& e){
+            if(_debug) logLine(LogLevel::error, "encstrset_freeze: set #", id, " cannot be frozen: ", e.what());
+            return false;
+        }
+    }
+    slot->frozen = true;
+    if(_debug) logLine(LogLevel::info, "encstrset_freeze: set #", id, " frozen");
+    return true;
+}
+
+unsigned long jnp1::encstrset_snapshot(unsigned long id){
+    if(_debug) logCall("encstrset_snapshot", id);
+
+    std::shared_ptr<SetStorage> contents;
+    SetKind kind;
+    {
+        ReadLock lock;
+        SetSlot* slot = lockSet(id, lock);
+        if(slot == nullptr){
+            if(_debug) logLine(LogLevel::error, "encstrset_snapshot: set #", id, " does not exist");
+            return ENCSTRSET_NO_SET;
         }
+        contents = slot->set;
+        kind = slot->kind;
+    }
+
+    // Shared contents are never modified (see mutableSet()), so the snapshot needs no copy. The source slot is
+    // unlocked first, since the registry mutex is never taken while holding a slot lock.
+    unsigned long snapshot = createSet(std::move(contents), kind, true);
+    if(snapshot == ENCSTRSET_NO_SET){
+        if(_debug) logLine(LogLevel::error, "encstrset_snapshot: too many sets");
+        return snapshot;
     }
-}
\ No newline at end of file
+    if(_debug) logLine(LogLevel::info, "encstrset_snapshot: set #", snapshot, " is a snapshot of set #", id);
+    return snapshot;
+}
+
+void jnp1::encstrset_thaw(unsigned long id){
+    if(_debug) logCall("encstrset_thaw", id);
+
+    WriteLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_thaw: set #", id, " does not exist");
+        return;
+    }
+
+    // Frozen contents are copied lazily, by the first modification (see mutableSet()).
+    slot->frozen = false;
+    if(_debug) logLine(LogLevel::info, "encstrset_thaw: set #", id, " can be modified");
+}
+
+namespace{
+
+// Adds memory taken by set in a locked slot to info. Contents already in counted are skipped, unless counted
+// is nullptr.
+void addMemoryUsage(const SetSlot& slot, jnp1::encstrset_memory_info& info,
+                    std::unordered_set<const SetStorage*>* counted){
+    info.sets++;
+    info.elements += slot.set->size();
+    if(slot.bloom != nullptr){
+        info.filter_bytes += slot.bloom->bits() / CHAR_BIT;
+    }
+    if(counted == nullptr || counted->insert(slot.set.get()).second){
+        MemoryUsage usage;
+        slot.set->memoryUsage(usage);
+        info.index_bytes += usage.indexBytes;
+        info.payload_bytes += usage.payloadBytes;
+        info.mapped_bytes += usage.mappedBytes;
+    }
+}
+
+}
+
+bool jnp1::encstrset_memory_usage(unsigned long id, encstrset_memory_info* info){
+    if(_debug) logCall("encstrset_memory_usage", id);
+
+    ReadLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_memory_usage: set #", id, " does not exist");
+        return false;
+    }
+
+    encstrset_memory_info usage{};
+    addMemoryUsage(*slot, usage, nullptr);
+    if(info != nullptr){
+        *info = usage;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_memory_usage: set #", id, " takes ", usage.index_bytes,
+        " byte(s) of index, ", usage.payload_bytes, " byte(s) of payload");
+    return true;
+}
+
+void jnp1::encstrset_memory_stats(encstrset_memory_info* info){
+    if(_debug) logCall("encstrset_memory_stats");
+
+    // Sets are visited one at a time, so the result is not a snapshot of any single moment.
+    encstrset_memory_info usage{};
+    std::unordered_set<const SetStorage*> counted;
+    const SlotDirectory* dir = registry().directory.load(std::memory_order_acquire);
+    if(dir != nullptr){
+        for(SetSlot* chunk: *dir){
+            for(size_t i = 0; i < chunkSize; i++){
+                ReadLock lock(chunk[i].mutex);
+                if(chunk[i].alive){
+                    addMemoryUsage(chunk[i], usage, &counted);
+                }
+            }
+        }
+        usage.other_bytes = dir->size() * chunkSize * sizeof(SetSlot);
+    }
+
+    MemoryUsage pool;
+    usage.pool_entries = InternPool::instance().memoryUsage(pool);
+    usage.pool_bytes = pool.indexBytes + pool.payloadBytes;
+    if(info != nullptr){
+        *info = usage;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_memory_stats: ", usage.sets, " set(s) take ", usage.index_bytes,
+        " byte(s) of index, ", usage.payload_bytes, " byte(s) of payload");
+}
+
+// Key handle is just an expanded key. Empty key means no encryption.
+struct jnp1::encstrset_key{
+    XorKey key;
+};
+
+namespace{
+
+const XorKey& keyOf(const jnp1::encstrset_key* key){
+    static const XorKey none;
+    return key == nullptr ? none : key->key;
+}
+
+Quoted quotedKey(const jnp1::encstrset_key* key){
+    return quoted(key == nullptr ? nullptr : key->key.original().data());
+}
+
+}
+
+jnp1::encstrset_key* jnp1::encstrset_key_new(const char* key){
+    if(_debug) logCall("encstrset_key_new", quoted(key));
+
+    auto handle = new encstrset_key{XorKey(view(key))};
+    if(_debug) logLine(LogLevel::info, "encstrset_key_new: key ", quoted(key), " expanded");
+    return handle;
+}
+
+void jnp1::encstrset_key_delete(encstrset_key* key){
+    if(_debug) logCall("encstrset_key_delete", quotedKey(key));
+    delete key;
+}
+
+bool jnp1::encstrset_insert_k(unsigned long id, const char* value, const encstrset_key* key){
+    if(_debug) logCall("encstrset_insert_k", id, quoted(value), quotedKey(key));
+
+    if(value == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_insert_k: invalid value (NULL)");
+        return false;
+    }
+    return insertValue("encstrset_insert_k", id, value, keyOf(key));
+}
+
+bool jnp1::encstrset_remove_k(unsigned long id, const char* value, const encstrset_key* key){
+    if(_debug) logCall("encstrset_remove_k", id, quoted(value), quotedKey(key));
+
+    if(value == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_remove_k: invalid value (NULL)");
+        return false;
+    }
+    return removeValue("encstrset_remove_k", id, value, keyOf(key));
+}
+
+bool jnp1::encstrset_test_k(unsigned long id, const char* value, const encstrset_key* key){
+    if(_debug) logCall("encstrset_test_k", id, quoted(value), quotedKey(key));
+
+    if(value == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_test_k: invalid value (NULL)");
+        return false;
+    }
+    return testValue("encstrset_test_k", id, value, keyOf(key));
+}
+
+// Cursor holds a reference to the contents it iterates. Sets do not modify contents referenced elsewhere, they
+// replace them with a copy first (see mutableSet()), so the contents stay intact until the cursor is freed.
+// Cursors visit cyphertexts from low (inclusive) to high (exclusive, unless unbounded). Ordered contents are entered
+// at low and left at the first cyphertext not below high, other contents are scanned whole, skipping cyphertexts
+// out of range.
+struct jnp1::encstrset_iter{
+    unsigned long id;
+    std::shared_ptr<const SetStorage> contents;
+    size_t position;
+    string low;
+    string high;
+    bool bounded;
+    // Ordered contents, walked with cursor, or nullptr.
+    const OrderedSet* ordered;
+    OrderedSet::Cursor cursor;
+    // Whether ordered contents have passed high.
+    bool finished;
+};
+
+namespace{
+
+// Opens a cursor over cyphertexts of the set from low to high (or to the end, unless bounded). Fn is used
+// in diagnostics.
+jnp1::encstrset_iter* openCursor(const char* fn, unsigned long id, string low, string high, bool bounded){
+    ReadLock lock;
+    SetSlot* slot = lockSet(id, lock);
+    if(slot == nullptr){
+        if(_debug) logLine(LogLevel::error, fn, ": set #", id, " does not exist");
+        return nullptr;
+    }
+
+    auto iter = new jnp1::encstrset_iter{id, slot->set, 0, std::move(low), std::move(high), bounded,
+        asOrdered(*slot->set), {}, false};
+    lock.unlock();
+    if(iter->ordered != nullptr){
+        iter->cursor = iter->ordered->seek(iter->low);
+    }
+    if(_debug) logLine(LogLevel::info, fn, ": set #", id, ", cursor over ", iter->contents->size(),
+        " element(s) opened");
+    return iter;
+}
+
+// Returns the least string greater than all strings starting with prefix, or false if there is none (prefix is
+// empty or consists of bytes 0xFF only).
+bool prefixEnd(string_view prefix, string& end){
+    end.assign(prefix);
+    while(!end.empty() && (unsigned char) end.back() == 0xFF){
+        end.pop_back();
+    }
+    if(end.empty()){
+        return false;
+    }
+    end.back()++;
+    return true;
+}
+
+}
+
+jnp1::encstrset_iter* jnp1::encstrset_iter_begin(unsigned long id){
+    if(_debug) logCall("encstrset_iter_begin", id);
+
+    return openCursor("encstrset_iter_begin", id, string(), string(), false);
+}
+
+jnp1::encstrset_iter* jnp1::encstrset_iter_range(unsigned long id, const char* low, size_t low_len,
+                                                 const char* high, size_t high_len, const char* key, size_t key_len){
+    if(_debug) logCall("encstrset_iter_range", id, quoted(low, low_len), low_len, quoted(high, high_len), high_len,
+        quoted(key, key_len), key_len);
+
+    string_view lowValue = low == nullptr ? string_view("") : string_view(low, low_len);
+    string_view highValue = high == nullptr ? string_view("") : string_view(high, high_len);
+    const XorKey& expanded = scratchKey(key == nullptr ? string_view() : string_view(key, key_len));
+    string lowCypher;
+    string highCypher;
+    expanded.encrypt(lowValue, lowCypher);
+    expanded.encrypt(highValue, highCypher);
+    return openCursor("encstrset_iter_range", id, std::move(lowCypher), std::move(highCypher), high != nullptr);
+}
+
+jnp1::encstrset_iter* jnp1::encstrset_iter_prefix(unsigned long id, const char* prefix, size_t prefix_len,
+                                                  const char* key, size_t key_len){
+    if(_debug) logCall("encstrset_iter_prefix", id, quoted(prefix, prefix_len), prefix_len, quoted(key, key_len),
+        key_len);
+
+    // Cypher of a prefix is a prefix of the cypher, since every byte is encrypted on its own.
+    string_view prefixValue = prefix == nullptr ? string_view("") : string_view(prefix, prefix_len);
+    string low;
+    scratchKey(key == nullptr ? string_view() : string_view(key, key_len)).encrypt(prefixValue, low);
+    string high;
+    bool bounded = prefixEnd(low, high);
+    return openCursor("encstrset_iter_prefix", id, std::move(low), std::move(high), bounded);
+}
+
+bool jnp1::encstrset_iter_next(encstrset_iter* iter, const char** value, size_t* value_len){
+    if(iter == nullptr){
+        if(_debug) logLine(LogLevel::error, "encstrset_iter_next: invalid cursor (NULL)");
+        return false;
+    }
+
+    string_view element;
+    for(;;){
+        bool found = iter->ordered != nullptr ? !iter->finished && iter->ordered->next(iter->cursor, element)
+                                              : iter->contents->next(iter->position, element);
+        if(!found){
+            if(_debug) logLine(LogLevel::info, "encstrset_iter_next: set #", iter->id, ", no more elements");
+            return false;
+        }
+        if(iter->bounded && element >= iter->high){
+            if(iter->ordered != nullptr){
+                // Ordered contents are not read any further.
+                iter->finished = true;
+            }
+            continue;
+        }
+        if(iter->ordered != nullptr || element >= iter->low){
+            break;
+        }
+    }
+    if(value != nullptr){
+        *value = element.data();
+    }
+    if(value_len != nullptr){
+        *value_len = element.size();
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_iter_next: set #", iter->id, ", cypher ", cypher(element));
+    return true;
+}
+
+void jnp1::encstrset_iter_end(encstrset_iter* iter){
+    if(iter == nullptr){
+        return;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_iter_end: set #", iter->id, ", cursor closed");
+    delete iter;
+}
+
+bool jnp1::encstrset_stats(encstrset_function function, encstrset_call_stats* stats){
+    if(_debug) logCall("encstrset_stats", (int) function);
+
+    if(!_stats){
+        if(_debug) logLine(LogLevel::error, "encstrset_stats: statistics are not compiled in");
+        return false;
+    }
+    if(function < 0 || function >= ENCSTRSET_FN_COUNT){
+        if(_debug) logLine(LogLevel::error, "encstrset_stats: invalid function ", (int) function);
+        return false;
+    }
+
+    detail::CallCounters totals = Stats::instance().totals(function);
+    encstrset_call_stats result{};
+    result.calls = totals.calls;
+    result.hits = totals.hits;
+    result.misses = totals.calls - totals.hits;
+    // Percentile p is reported as the upper bound of the bucket holding the call ranked p * calls.
+    size_t* percentiles[] = {&result.p50_ns, &result.p99_ns, &result.p999_ns};
+    const double ranks[] = {0.5, 0.99, 0.999};
+    uint64_t seen = 0;
+    size_t next = 0;
+    for(size_t b = 0; b < ENCSTRSET_LATENCY_BUCKETS; b++){
+        result.latency[b] = totals.latency[b];
+        seen += totals.latency[b];
+        for(; next < 3 && totals.calls > 0 && seen >= ranks[next] * totals.calls; next++){
+            *percentiles[next] = (size_t(2) << b) - 1;
+        }
+    }
+    if(stats != nullptr){
+        *stats = result;
+    }
+    if(_debug) logLine(LogLevel::info, "encstrset_stats: function ", (int) function, " called ", result.calls,
+        " time(s), median ", result.p50_ns, " ns");
+    return true;
+}
+
+void jnp1::encstrset_stats_reset(){
+    if(_debug) logCall("encstrset_stats_reset");
+    if(_stats) Stats::instance().reset();
+}
+
+void jnp1::encstrset_deferred_reclaim(bool enable){
+    if(_debug) logCall("encstrset_deferred_reclaim", enable ? "true" : "false");
+
+    if(enable){
+        // Starts the thread before the first set is handed to it.
+        Reclaimer::instance();
+    }
+    deferredReclaim().store(enable, std::memory_order_relaxed);
+    if(_debug) logLine(LogLevel::info, "encstrset_deferred_reclaim: deferred reclamation ", enable ? "on" : "off");
+}
+
+void jnp1::encstrset_log_level(int level){
+    if(_debug) detail::Logger::instance().setLevel(level);
+}
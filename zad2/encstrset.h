@@ -9,13 +9,40 @@
     #include <stdbool.h>
 #endif
 
+// Returned instead of an id when no set could be created.
+#define ENCSTRSET_NO_SET ((unsigned long) -1)
+
+// Number of latency buckets in struct encstrset_call_stats.
+#define ENCSTRSET_LATENCY_BUCKETS 32
+
 #ifdef __cplusplus
 namespace jnp1{
     extern "C" {
 #endif
 
+    // Returns ENCSTRSET_NO_SET if there are too many sets: ids hold the slot of a set in half of their bits, so
+    // fewer than 2^32 sets (2^16 where unsigned long has 32 bits) can exist at a time.
     unsigned long encstrset_new();
 
+    // Same as encstrset_new(), but the set is created with room for n elements, so inserting them never grows it.
+    unsigned long encstrset_new_with_capacity(size_t n);
+
+    // Makes room for n elements in the set, so that inserting up to n elements in total does not grow it.
+    // Returns false if the set does not exist or is frozen.
+    bool encstrset_reserve(unsigned long id, size_t n);
+
+    // Creates a set that behaves like one created by encstrset_new(), but keeps its cyphertexts in a pool shared
+    // by all interned sets, each distinct cyphertext stored once, and itself stores only their integer ids. Meant for
+    // many overlapping sets: memory shrinks with the overlap and encstrset_copy() and other operations on two
+    // interned sets compare ids instead of cyphertexts. Tests and modifications pay for an extra pool lookup.
+    unsigned long encstrset_new_interned();
+
+    // Creates a set that behaves like one created by encstrset_new(), but keeps its cyphertexts sorted in byte order
+    // (as compared by memcmp), so cursors opened by encstrset_iter_range() and encstrset_iter_prefix() visit them
+    // in order and reach the first one in the range in O(log n). Tests take O(log n) comparisons of cyphertexts
+    // instead of a hash probe. Such a set stays ordered when frozen.
+    unsigned long encstrset_new_ordered();
+
     void encstrset_delete(unsigned long id);
 
     size_t encstrset_size(unsigned long id);
@@ -30,6 +57,188 @@ namespace jnp1{
 
     void encstrset_copy(unsigned long src_id, unsigned long dst_id);
 
+    // Operations below work on sets with identifiers src_id and dst_id and store the result in dst_id, leaving src_id
+    // intact. If any of the sets does not exist, they do nothing. They work on stored cyphertexts, iterating
+    // the smaller set and probing the larger one. Sets of 65536 or more elements are kept split by hash into
+    // partitions, which such operations (and encstrset_copy()) combine independently on one thread per core.
+
+    // Adds elements of src_id to dst_id. Same as encstrset_copy().
+    void encstrset_union_into(unsigned long src_id, unsigned long dst_id);
+
+    // Removes from dst_id elements that are not in src_id.
+    void encstrset_intersect(unsigned long src_id, unsigned long dst_id);
+
+    // Removes from dst_id elements that are in src_id.
+    void encstrset_difference(unsigned long src_id, unsigned long dst_id);
+
+    // Writes contents of the set to a file at path, replacing it. Returns false if the set does not exist or
+    // the file could not be written.
+    bool encstrset_save(unsigned long id, const char* path);
+
+    // Creates a new set with contents of a file written by encstrset_save() and returns its id. The file is mapped
+    // into memory and probed in place, so the set can be used right away, without rebuilding it. File contents are
+    // copied only when the set is first modified. The file should not be modified while the set exists.
+    // Returns ENCSTRSET_NO_SET if the file cannot be read or is not a valid set file, or if there are too many sets.
+    unsigned long encstrset_load(const char* path);
+
+    // Statistics of a set's Bloom filter.
+    struct encstrset_bloom_info{
+        size_t bits;            // size of the filter
+        size_t queries;         // tests that consulted the filter
+        size_t rejected;        // tests answered by the filter alone
+        size_t false_positives; // tests the filter passed although the element was absent
+        size_t rebuilds;        // rebuilds caused by growth of the set or by removals
+    };
+
+    // Puts a Bloom filter in front of the set, so that most tests of absent elements skip probing the set.
+    // The filter uses bits_per_element bits per element (0 means the default of 10, which gives about 1% false
+    // positives). It is kept up to date by all operations and rebuilt after many removals. Enabling it again
+    // rebuilds it with new settings. Returns false if the set does not exist.
+    bool encstrset_bloom_enable(unsigned long id, size_t bits_per_element);
+
+    // Removes the Bloom filter of the set, if it has one.
+    void encstrset_bloom_disable(unsigned long id);
+
+    // Fills stats with statistics of the set's Bloom filter. Returns false if the set does not exist or has
+    // no filter.
+    bool encstrset_bloom_stats(unsigned long id, struct encstrset_bloom_info* stats);
+
+    // Converts the set into an immutable representation indexed with a minimal perfect hash function: each test
+    // probes exactly one position and the set takes little more memory than its elements. Until encstrset_thaw() is
+    // called, all operations that would modify the set fail and leave it intact. Returns false if the set does not
+    // exist or cannot be frozen.
+    bool encstrset_freeze(unsigned long id);
+
+    // Creates a frozen set (see encstrset_freeze()) with contents of the set at the moment of the call and returns its
+    // id, or ENCSTRSET_NO_SET if the set does not exist or there are too many sets. Takes constant time, since
+    // the snapshot shares contents with the set instead of copying them, and can be read concurrently with writers
+    // of the set. Large flat sets are split into partitions, so that a modification following a snapshot copies
+    // just the partition it touches; interned and ordered sets are copied whole.
+    // The snapshot is deleted like any other set; encstrset_thaw() turns it into an independent, modifiable copy.
+    unsigned long encstrset_snapshot(unsigned long id);
+
+    // Makes a frozen set modifiable again. It is converted back to the regular representation on first modification.
+    void encstrset_thaw(unsigned long id);
+
+    // Cursor over elements of a set, created by encstrset_iter_begin() and freed by encstrset_iter_end().
+    struct encstrset_iter;
+
+    // Opens a cursor over cyphertexts the set holds at the moment of the call. The cursor shares the set's contents
+    // instead of copying them, so later modifications of the set are not seen through it (the first of them copies
+    // the contents instead). Returns NULL if the set does not exist.
+    struct encstrset_iter* encstrset_iter_begin(unsigned long id);
+
+    // Stores a pointer to the next cyphertext in *value and its length in *value_len and returns true, or returns
+    // false once all cyphertexts have been visited. Cyphertexts are not NUL-terminated and stay valid until the cursor
+    // is freed. Nothing is allocated or copied. A cursor may not be used by several threads at once, but any number
+    // of cursors may run concurrently with each other and with other operations.
+    bool encstrset_iter_next(struct encstrset_iter* iter, const char** value, size_t* value_len);
+
+    // Same as encstrset_iter_begin(), but the cursor visits only cyphertexts c with low <= c < high in byte order,
+    // where low and high are cyphertexts of the given values under key (NULL key or key_len equal to 0 means no
+    // encryption). NULL high means no upper bound. Cursors over sets created by encstrset_new_ordered() visit
+    // cyphertexts in order and start right at low; over other sets they scan the whole set in no particular order.
+    struct encstrset_iter* encstrset_iter_range(unsigned long id, const char* low, size_t low_len, const char* high,
+                                                size_t high_len, const char* key, size_t key_len);
+
+    // Same as encstrset_iter_range(), but the cursor visits cyphertexts starting with the cyphertext of prefix
+    // under key.
+    struct encstrset_iter* encstrset_iter_prefix(unsigned long id, const char* prefix, size_t prefix_len,
+                                                 const char* key, size_t key_len);
+
+    void encstrset_iter_end(struct encstrset_iter* iter);
+
+    // Key expanded once for use in many calls. Created by encstrset_key_new(), which makes a copy of the key,
+    // and freed by encstrset_key_delete(). Can be shared between threads.
+    struct encstrset_key;
+
+    // Returns handle of key. NULL or empty key means no encryption.
+    struct encstrset_key* encstrset_key_new(const char* key);
+
+    void encstrset_key_delete(struct encstrset_key* key);
+
+    // Same as encstrset_insert(), encstrset_remove() and encstrset_test(), but with key given by a handle
+    // (NULL means no encryption), which spares measuring and expanding the key on every call.
+    bool encstrset_insert_k(unsigned long id, const char* value, const struct encstrset_key* key);
+    bool encstrset_remove_k(unsigned long id, const char* value, const struct encstrset_key* key);
+    bool encstrset_test_k(unsigned long id, const char* value, const struct encstrset_key* key);
+
+    // Same as encstrset_insert(), encstrset_remove() and encstrset_test(), but with lengths of value and key given
+    // explicitly. Neither is scanned for its terminating NUL, so both may contain arbitrary bytes, NULs included.
+    // NULL key or key_len equal to 0 means no encryption.
+    bool encstrset_insert_n(unsigned long id, const char* value, size_t value_len, const char* key, size_t key_len);
+    bool encstrset_remove_n(unsigned long id, const char* value, size_t value_len, const char* key, size_t key_len);
+    bool encstrset_test_n(unsigned long id, const char* value, size_t value_len, const char* key, size_t key_len);
+
+    // Memory taken by sets, in bytes allocated by them.
+    struct encstrset_memory_info{
+        size_t sets;            // sets counted
+        size_t elements;        // elements of these sets
+        size_t index_bytes;     // hash tables: control bytes, slots, perfect hash data, tables of interned ids
+        size_t payload_bytes;   // stored cyphertexts with length prefixes, space left by removed ones included
+        size_t filter_bytes;    // Bloom filters
+        size_t mapped_bytes;    // contents mapped from files by encstrset_load(), resident only when paged in
+        size_t pool_entries;    // distinct cyphertexts in the pool of interned sets
+        size_t pool_bytes;      // the pool: its entries, index and cyphertexts
+        size_t other_bytes;     // bookkeeping of sets that exist or existed
+    };
+
+    // Fills info with memory taken by the set. Contents shared with other sets (see encstrset_copy()) are counted
+    // in full, cyphertexts of interned sets and bookkeeping are not counted at all (pool and other fields are 0).
+    // Returns false if the set does not exist.
+    bool encstrset_memory_usage(unsigned long id, struct encstrset_memory_info* info);
+
+    // Fills info with memory taken by all sets together. Shared contents are counted once.
+    void encstrset_memory_stats(struct encstrset_memory_info* info);
+
+    // Functions whose calls are counted when the library is compiled with -DENCSTRSET_STATS. Variants of a function
+    // (e.g. encstrset_insert_k() and encstrset_insert_n()) are counted together with it.
+    enum encstrset_function{
+        ENCSTRSET_FN_NEW,
+        ENCSTRSET_FN_DELETE,
+        ENCSTRSET_FN_SIZE,
+        ENCSTRSET_FN_INSERT,
+        ENCSTRSET_FN_REMOVE,
+        ENCSTRSET_FN_TEST,
+        ENCSTRSET_FN_CLEAR,
+        ENCSTRSET_FN_COPY,
+        ENCSTRSET_FN_UNION_INTO,
+        ENCSTRSET_FN_INTERSECT,
+        ENCSTRSET_FN_DIFFERENCE,
+        ENCSTRSET_FN_COUNT
+    };
+
+    // Statistics of calls of one function.
+    struct encstrset_call_stats{
+        size_t calls;
+        size_t hits;     // calls returning true, or for functions returning nothing else, calls on existing sets
+        size_t misses;   // other calls
+        // Bucket b counts calls that took from 2^b to 2^(b+1) - 1 nanoseconds, the last one also longer ones.
+        size_t latency[ENCSTRSET_LATENCY_BUCKETS];
+        // Upper bounds of latency percentiles, read from the buckets.
+        size_t p50_ns;
+        size_t p99_ns;
+        size_t p999_ns;
+    };
+
+    // Fills stats with statistics of calls of function since start or since encstrset_stats_reset(). Each thread
+    // counts its own calls, the call sums them up. Returns false if function is invalid or the library was compiled
+    // without -DENCSTRSET_STATS, in which case counting costs nothing.
+    bool encstrset_stats(enum encstrset_function function, struct encstrset_call_stats* stats);
+
+    // Starts counting all functions from zero.
+    void encstrset_stats_reset();
+
+    // Turns freeing of contents of cleared and deleted sets on a background thread on or off (it is off initially).
+    // Either way contents are freed after the set is unlocked; with it on, encstrset_clear() and encstrset_delete()
+    // take constant time regardless of size of the set, at the cost of memory being returned a bit later.
+    void encstrset_deferred_reclaim(bool enable);
+
+    // Sets level of diagnostic messages: 0 - none, 1 - errors, 2 - results of operations, 3 - also function calls.
+    // Initial level is taken from ENCSTRSET_LOG_LEVEL environment variable, 3 if it is not set.
+    // Has no effect when compiled with -DNDEBUG.
+    void encstrset_log_level(int level);
+
 #ifdef __cplusplus
     }
 }
@@ -0,0 +1,148 @@
+#include "encstrset.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+
+// Single-threaded benchmark of encstrset operations. For every set size (10 to max_size, by factors of 10), value
+// length (4 to 4096 bytes, by factors of 4) and key (none or 7 bytes) it measures insert, test of present
+// and of absent values, copy into a non-empty set, remove and clear. Combinations holding more than max_bytes
+// of values are skipped. Small sets are measured repeatedly, so every figure covers at least minOps operations.
+//
+// Prints CSV: operation, set size, value length, key length, nanoseconds per operation (per element for copy and
+// clear) and bytes per element taken by the filled set.
+//
+// Usage: encstrset_bench [max_size [max_bytes]]
+// Build with -DNDEBUG, otherwise diagnostic output dominates the measurement.
+
+namespace {
+    const size_t minOps = 1000000;
+    const char key[] = "bench01";
+
+    using Clock = std::chrono::steady_clock;
+
+    // Value i is a run of 'x' starting with bytes of i, so values are distinct even when 4 bytes long.
+    class Values {
+        public:
+        explicit Values(size_t length): buffer(length, 'x') {}
+
+        const char* get(size_t i) {
+            std::memcpy(&buffer[0], &i, std::min(sizeof(i), buffer.size()));
+            return buffer.data();
+        }
+
+        size_t length() const {
+            return buffer.size();
+        }
+
+        private:
+        std::string buffer;
+    };
+
+    struct Totals {
+        double insert = 0;
+        double testHit = 0;
+        double testMiss = 0;
+        double copy = 0;
+        double remove = 0;
+        double clear = 0;
+        size_t bytes = 0;
+    };
+
+    double since(Clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    void fill(unsigned long id, Values& values, size_t size, size_t keyLength) {
+        for (size_t i = 0; i < size; i++) {
+            ::jnp1::encstrset_insert_n(id, values.get(i), values.length(), key, keyLength);
+        }
+    }
+
+    // Runs one round of every operation on a set of given size and adds times in nanoseconds to totals.
+    void round(Totals& totals, Values& values, size_t size, size_t keyLength) {
+        unsigned long id = ::jnp1::encstrset_new();
+        Clock::time_point start = Clock::now();
+        fill(id, values, size, keyLength);
+        totals.insert += since(start);
+
+        ::jnp1::encstrset_memory_info memory;
+        ::jnp1::encstrset_memory_usage(id, &memory);
+        totals.bytes = memory.index_bytes + memory.payload_bytes;
+
+        size_t hits = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < size; i++) {
+            hits += ::jnp1::encstrset_test_n(id, values.get(i), values.length(), key, keyLength);
+        }
+        totals.testHit += since(start);
+        start = Clock::now();
+        for (size_t i = size; i < 2 * size; i++) {
+            hits += ::jnp1::encstrset_test_n(id, values.get(i), values.length(), key, keyLength);
+        }
+        totals.testMiss += since(start);
+        if (hits != size) {
+            std::fprintf(stderr, "encstrset_bench: %zu hits instead of %zu\n", hits, size);
+            std::exit(1);
+        }
+
+        // Copying into an empty set would only share contents, so the destination gets one element first.
+        unsigned long copy = ::jnp1::encstrset_new();
+        ::jnp1::encstrset_insert_n(copy, "", 0, nullptr, 0);
+        start = Clock::now();
+        ::jnp1::encstrset_copy(id, copy);
+        totals.copy += since(start);
+
+        start = Clock::now();
+        ::jnp1::encstrset_clear(copy);
+        totals.clear += since(start);
+        ::jnp1::encstrset_delete(copy);
+
+        start = Clock::now();
+        for (size_t i = 0; i < size; i++) {
+            ::jnp1::encstrset_remove_n(id, values.get(i), values.length(), key, keyLength);
+        }
+        totals.remove += since(start);
+        ::jnp1::encstrset_delete(id);
+    }
+
+    void report(const char* operation, size_t size, size_t length, size_t keyLength, double nanoseconds,
+                size_t ops, size_t bytes) {
+        std::printf("%s,%zu,%zu,%zu,%.1f,%.1f\n", operation, size, length, keyLength, nanoseconds / ops,
+                    (double) bytes / size);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t maxSize = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+    size_t maxBytes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : (size_t) 1 << 28;
+
+    std::printf("operation,size,value_bytes,key_bytes,ns_per_op,bytes_per_element\n");
+    for (size_t size = 10; size <= maxSize; size *= 10) {
+        for (size_t length = 4; length <= 4096; length *= 4) {
+            if (size * length > maxBytes) {
+                continue;
+            }
+            Values values(length);
+            for (size_t keyLength: {(size_t) 0, sizeof(key) - 1}) {
+                size_t rounds = std::max<size_t>(1, minOps / size);
+                Totals totals;
+                for (size_t r = 0; r < rounds; r++) {
+                    round(totals, values, size, keyLength);
+                }
+                size_t ops = rounds * size;
+                report("insert", size, length, keyLength, totals.insert, ops, totals.bytes);
+                report("test_hit", size, length, keyLength, totals.testHit, ops, totals.bytes);
+                report("test_miss", size, length, keyLength, totals.testMiss, ops, totals.bytes);
+                report("copy", size, length, keyLength, totals.copy, ops, totals.bytes);
+                report("remove", size, length, keyLength, totals.remove, ops, totals.bytes);
+                report("clear", size, length, keyLength, totals.clear, ops, totals.bytes);
+                std::fflush(stdout);
+            }
+        }
+    }
+}
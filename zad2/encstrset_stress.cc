@@ -0,0 +1,73 @@
+#include "encstrset.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stress benchmark of concurrent encstrset usage. Every thread repeatedly tests values against one shared set
+// and inserts/removes values in its own private set. Prints throughput for growing numbers of threads,
+// so contention shows up as speedup flattening out.
+//
+// Usage: encstrset_stress [max_threads [ops_per_thread]]
+// Build with -DNDEBUG, otherwise diagnostic output dominates the measurement.
+
+namespace {
+    const size_t sharedValues = 1 << 14;
+
+    std::string value(size_t i) {
+        return "value" + std::to_string(i);
+    }
+
+    void worker(unsigned long shared, size_t thread, size_t ops) {
+        unsigned long own = ::jnp1::encstrset_new();
+        size_t hits = 0;
+        for (size_t i = 0; i < ops; i++) {
+            std::string v = value((i * 7919 + thread) % (2 * sharedValues));
+            if (i % 10 == 0) {
+                if (!::jnp1::encstrset_insert(own, v.c_str(), "key")) {
+                    ::jnp1::encstrset_remove(own, v.c_str(), "key");
+                }
+            } else {
+                hits += ::jnp1::encstrset_test(shared, v.c_str(), "key");
+            }
+        }
+        ::jnp1::encstrset_delete(own);
+        if (hits > ops) {
+            std::abort();
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t maxThreads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 32;
+    size_t ops = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+    unsigned long shared = ::jnp1::encstrset_new();
+    for (size_t i = 0; i < sharedValues; i++) {
+        ::jnp1::encstrset_insert(shared, value(i).c_str(), "key");
+    }
+
+    std::printf("threads,ops,seconds,mops_per_second,speedup\n");
+    double base = 0;
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < threads; t++) {
+            pool.emplace_back(worker, shared, t, ops);
+        }
+        for (std::thread& t: pool) {
+            t.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double mops = threads * ops / seconds / 1e6;
+        if (base == 0) {
+            base = mops;
+        }
+        std::printf("%zu,%zu,%.3f,%.3f,%.2f\n", threads, threads * ops, seconds, mops, mops / base);
+    }
+
+    ::jnp1::encstrset_delete(shared);
+}
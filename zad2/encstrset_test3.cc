@@ -0,0 +1,699 @@
+#include "encstrset.h"
+
+#ifdef NDEBUG
+    #undef NDEBUG
+#endif
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+// Tests of extensions of the original interface.
+
+namespace {
+    const char* path = "encstrset_test3.tmp";
+
+    void testSaveLoad() {
+        unsigned long id = ::jnp1::encstrset_new();
+        ::jnp1::encstrset_insert(id, "foo", "123");
+        ::jnp1::encstrset_insert(id, "bar", nullptr);
+        ::jnp1::encstrset_insert(id, "baz", "x");
+        ::jnp1::encstrset_remove(id, "baz", "x");
+        assert(::jnp1::encstrset_save(id, path));
+        assert(!::jnp1::encstrset_save(id + 1, path));
+
+        unsigned long loaded = ::jnp1::encstrset_load(path);
+        assert(loaded != ENCSTRSET_NO_SET);
+        assert(::jnp1::encstrset_size(loaded) == 2);
+        assert(::jnp1::encstrset_test(loaded, "foo", "123"));
+        assert(::jnp1::encstrset_test(loaded, "bar", ""));
+        assert(!::jnp1::encstrset_test(loaded, "baz", "x"));
+
+        // First modification replaces the mapped file with a private copy.
+        assert(::jnp1::encstrset_insert(loaded, "qux", "k"));
+        assert(!::jnp1::encstrset_insert(loaded, "foo", "123"));
+        assert(::jnp1::encstrset_size(loaded) == 3);
+        assert(::jnp1::encstrset_size(id) == 2);
+
+        ::jnp1::encstrset_delete(id);
+        ::jnp1::encstrset_delete(loaded);
+        std::remove(path);
+        assert(::jnp1::encstrset_load(path) == ENCSTRSET_NO_SET);
+    }
+
+    // Fields of the set file header, at their offsets.
+    const size_t capacityField = 24, arenaSizeField = 32, slotsOffsetField = 48, arenaOffsetField = 56;
+
+    uint64_t field(const std::string& file, size_t at) {
+        uint64_t value;
+        std::memcpy(&value, file.data() + at, sizeof(value));
+        return value;
+    }
+
+    void setField(std::string& file, size_t at, uint64_t value) {
+        std::memcpy(&file[at], &value, sizeof(value));
+    }
+
+    bool loads(const std::string& file) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << file;
+        unsigned long id = ::jnp1::encstrset_load(path);
+        ::jnp1::encstrset_delete(id);
+        return id != ENCSTRSET_NO_SET;
+    }
+
+    // Files whose header is consistent but whose table points outside of them are rejected too.
+    void testCorruptFile() {
+        unsigned long id = ::jnp1::encstrset_new();
+        ::jnp1::encstrset_insert(id, "foo", "123");
+        ::jnp1::encstrset_insert(id, "bar", nullptr);
+        assert(::jnp1::encstrset_save(id, path));
+        ::jnp1::encstrset_delete(id);
+        std::ifstream in(path, std::ios::binary);
+        const std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        assert(loads(file));
+
+        std::string truncated = file.substr(0, file.size() - 2);
+        setField(truncated, arenaSizeField, field(file, arenaSizeField) - 2);
+        assert(!loads(truncated));
+
+        std::string farOffsets = file;
+        for (uint64_t i = 0; i < field(file, capacityField); i++) {
+            setField(farOffsets, field(file, slotsOffsetField) + 16 * i + 8, uint64_t(1) << 40);
+        }
+        assert(!loads(farOffsets));
+
+        // Offsets computed from this capacity wrap around to the ones in the file.
+        std::string huge = file;
+        uint64_t capacity = uint64_t(1) << 60;
+        uint64_t slotsOffset = field(file, slotsOffsetField) - field(file, capacityField) + capacity;
+        uint64_t arenaOffset = slotsOffset + 16 * capacity;
+        setField(huge, capacityField, capacity);
+        setField(huge, slotsOffsetField, slotsOffset);
+        setField(huge, arenaOffsetField, arenaOffset);
+        setField(huge, arenaSizeField, file.size() - arenaOffset);
+        assert(!loads(huge));
+
+        std::remove(path);
+    }
+
+    void testBloom() {
+        unsigned long id = ::jnp1::encstrset_new();
+        ::jnp1::encstrset_bloom_info stats;
+        assert(!::jnp1::encstrset_bloom_stats(id, &stats));
+        ::jnp1::encstrset_insert(id, "before", "k");
+        assert(::jnp1::encstrset_bloom_enable(id, 0));
+
+        char value[16];
+        for (int i = 0; i < 1000; i++) {
+            std::snprintf(value, sizeof(value), "v%d", i);
+            ::jnp1::encstrset_insert(id, value, "k");
+        }
+        assert(::jnp1::encstrset_test(id, "before", "k"));
+        for (int i = 0; i < 1000; i++) {
+            std::snprintf(value, sizeof(value), "v%d", i);
+            assert(::jnp1::encstrset_test(id, value, "k"));
+            std::snprintf(value, sizeof(value), "w%d", i);
+            assert(!::jnp1::encstrset_test(id, value, "k"));
+        }
+        for (int i = 0; i < 900; i++) {
+            std::snprintf(value, sizeof(value), "v%d", i);
+            ::jnp1::encstrset_remove(id, value, "k");
+        }
+        for (int i = 900; i < 1000; i++) {
+            std::snprintf(value, sizeof(value), "v%d", i);
+            assert(::jnp1::encstrset_test(id, value, "k"));
+        }
+
+        assert(::jnp1::encstrset_bloom_stats(id, &stats));
+        assert(stats.queries == 2101);
+        assert(stats.rejected + stats.false_positives == 1000);
+        assert(stats.false_positives < 100);
+        assert(stats.rebuilds > 0);
+
+        ::jnp1::encstrset_bloom_disable(id);
+        assert(!::jnp1::encstrset_bloom_stats(id, &stats));
+        ::jnp1::encstrset_delete(id);
+    }
+
+    unsigned long newSet(bool interned) {
+        return interned ? ::jnp1::encstrset_new_interned() : ::jnp1::encstrset_new();
+    }
+
+    unsigned long makeSet(const char* const* values, bool interned) {
+        unsigned long id = newSet(interned);
+        for (; *values != nullptr; values++) {
+            ::jnp1::encstrset_insert(id, *values, "key");
+        }
+        return id;
+    }
+
+    void testAlgebra(bool interned) {
+        const char* small[] = {"a", "b", "c", nullptr};
+        const char* large[] = {"b", "c", "d", "e", "f", nullptr};
+        unsigned long a = makeSet(small, interned);
+        unsigned long b = makeSet(large, interned);
+
+        unsigned long i1 = makeSet(small, interned);
+        ::jnp1::encstrset_intersect(b, i1);
+        unsigned long i2 = makeSet(large, interned);
+        ::jnp1::encstrset_intersect(a, i2);
+        assert(::jnp1::encstrset_size(i1) == 2 && ::jnp1::encstrset_size(i2) == 2);
+        assert(::jnp1::encstrset_test(i1, "b", "key") && ::jnp1::encstrset_test(i2, "c", "key"));
+        assert(!::jnp1::encstrset_test(i2, "d", "key"));
+
+        unsigned long d1 = makeSet(small, interned);
+        ::jnp1::encstrset_difference(b, d1);
+        unsigned long d2 = makeSet(large, interned);
+        ::jnp1::encstrset_difference(a, d2);
+        assert(::jnp1::encstrset_size(d1) == 1 && ::jnp1::encstrset_test(d1, "a", "key"));
+        assert(::jnp1::encstrset_size(d2) == 3 && !::jnp1::encstrset_test(d2, "b", "key"));
+
+        // Shared contents must not be modified through the destination.
+        unsigned long shared = newSet(interned);
+        ::jnp1::encstrset_copy(b, shared);
+        ::jnp1::encstrset_difference(a, shared);
+        assert(::jnp1::encstrset_size(b) == 5 && ::jnp1::encstrset_size(shared) == 3);
+
+        ::jnp1::encstrset_union_into(a, d2);
+        assert(::jnp1::encstrset_size(d2) == 6);
+        ::jnp1::encstrset_difference(d2, d2);
+        assert(::jnp1::encstrset_size(d2) == 0);
+        ::jnp1::encstrset_intersect(a, a);
+        assert(::jnp1::encstrset_size(a) == 3);
+
+        for (unsigned long id: {a, b, i1, i2, d1, d2, shared}) {
+            ::jnp1::encstrset_delete(id);
+        }
+    }
+
+    void testKeys() {
+        const char* keys[] = {"k", "ab", "1538221", "0123456789abcdef0123", ""};
+        std::string value;
+        for (const char* key: keys) {
+            ::jnp1::encstrset_key* handle = ::jnp1::encstrset_key_new(key);
+            unsigned long id = ::jnp1::encstrset_new();
+            value.clear();
+            for (int length = 0; length < 40; length++) {
+                assert(::jnp1::encstrset_insert_k(id, value.c_str(), handle));
+                assert(::jnp1::encstrset_test(id, value.c_str(), key));
+                assert(!::jnp1::encstrset_insert(id, value.c_str(), key));
+                value += (char) ('A' + length);
+            }
+            assert(::jnp1::encstrset_remove_k(id, "", handle));
+            assert(!::jnp1::encstrset_test_k(id, "", handle));
+            ::jnp1::encstrset_delete(id);
+            ::jnp1::encstrset_key_delete(handle);
+        }
+        unsigned long id = ::jnp1::encstrset_new();
+        assert(::jnp1::encstrset_insert_k(id, "plain", nullptr));
+        assert(::jnp1::encstrset_test(id, "plain", nullptr));
+        ::jnp1::encstrset_delete(id);
+    }
+
+    void testBinary() {
+        unsigned long id = ::jnp1::encstrset_new();
+        const char value[] = {'a', '\0', 'b'};
+        const char key[] = {'\0', 'x'};
+        assert(::jnp1::encstrset_insert_n(id, value, 3, key, 2));
+        assert(::jnp1::encstrset_test_n(id, value, 3, key, 2));
+        assert(!::jnp1::encstrset_test_n(id, value, 1, key, 2));
+        assert(!::jnp1::encstrset_test_n(id, value, 3, key, 1));
+        assert(::jnp1::encstrset_insert_n(id, value, 1, nullptr, 0));
+        assert(::jnp1::encstrset_test(id, "a", nullptr));
+        assert(::jnp1::encstrset_test_n(id, "abc", 1, "ignored", 0));
+        assert(::jnp1::encstrset_size(id) == 2);
+        assert(::jnp1::encstrset_remove_n(id, value, 3, key, 2));
+        assert(!::jnp1::encstrset_insert_n(id, nullptr, 0, nullptr, 0));
+        assert(::jnp1::encstrset_size(id) == 1);
+        ::jnp1::encstrset_delete(id);
+    }
+
+    void testFreeze() {
+        unsigned long id = ::jnp1::encstrset_new();
+        std::string value;
+        for (int i = 0; i < 5000; i++) {
+            value = "element" + std::to_string(i);
+            ::jnp1::encstrset_insert(id, value.c_str(), "key");
+        }
+        assert(::jnp1::encstrset_freeze(id));
+        assert(::jnp1::encstrset_size(id) == 5000);
+        for (int i = 0; i < 5000; i++) {
+            value = "element" + std::to_string(i);
+            assert(::jnp1::encstrset_test(id, value.c_str(), "key"));
+            value = "missing" + std::to_string(i);
+            assert(!::jnp1::encstrset_test(id, value.c_str(), "key"));
+        }
+
+        assert(!::jnp1::encstrset_insert(id, "new", "key"));
+        assert(!::jnp1::encstrset_remove(id, "element0", "key"));
+        ::jnp1::encstrset_clear(id);
+        assert(::jnp1::encstrset_size(id) == 5000);
+
+        unsigned long copy = ::jnp1::encstrset_new();
+        ::jnp1::encstrset_insert(copy, "other", nullptr);
+        ::jnp1::encstrset_copy(id, copy);
+        assert(::jnp1::encstrset_size(copy) == 5001);
+
+        ::jnp1::encstrset_thaw(id);
+        assert(::jnp1::encstrset_remove(id, "element0", "key"));
+        assert(::jnp1::encstrset_insert(id, "new", "key"));
+        assert(::jnp1::encstrset_size(id) == 5000);
+
+        unsigned long empty = ::jnp1::encstrset_new();
+        assert(::jnp1::encstrset_freeze(empty));
+        assert(!::jnp1::encstrset_test(empty, "", nullptr));
+
+        ::jnp1::encstrset_delete(id);
+        ::jnp1::encstrset_delete(copy);
+        ::jnp1::encstrset_delete(empty);
+    }
+
+    void testInterned() {
+        const char* values[] = {"x", "y", "z", nullptr};
+        unsigned long a = makeSet(values, true);
+        unsigned long b = ::jnp1::encstrset_new_interned();
+        ::jnp1::encstrset_insert(b, "y", "key");
+        ::jnp1::encstrset_insert(b, "w", "key");
+        ::jnp1::encstrset_union_into(a, b);
+        assert(::jnp1::encstrset_size(b) == 4);
+
+        // Elements shared through the pool stay in other sets when removed from one.
+        assert(::jnp1::encstrset_remove(a, "y", "key"));
+        ::jnp1::encstrset_clear(a);
+        assert(!::jnp1::encstrset_test(a, "x", "key"));
+        assert(::jnp1::encstrset_test(b, "x", "key") && ::jnp1::encstrset_test(b, "y", "key"));
+        ::jnp1::encstrset_delete(a);
+        assert(::jnp1::encstrset_test(b, "z", "key"));
+
+        // Mixing kinds keeps the kind of the destination.
+        unsigned long flat = makeSet(values, false);
+        ::jnp1::encstrset_insert(flat, "v", "key");
+        ::jnp1::encstrset_union_into(flat, b);
+        ::jnp1::encstrset_union_into(b, flat);
+        assert(::jnp1::encstrset_size(b) == 5 && ::jnp1::encstrset_size(flat) == 5);
+        unsigned long c = ::jnp1::encstrset_new_interned();
+        ::jnp1::encstrset_copy(flat, c);
+        assert(::jnp1::encstrset_insert(c, "u", "key"));
+        assert(::jnp1::encstrset_size(c) == 6 && ::jnp1::encstrset_size(flat) == 5);
+        assert(::jnp1::encstrset_remove(c, "x", "key") && ::jnp1::encstrset_test(flat, "x", "key"));
+
+        assert(::jnp1::encstrset_freeze(c));
+        assert(::jnp1::encstrset_test(c, "u", "key") && !::jnp1::encstrset_test(c, "x", "key"));
+        ::jnp1::encstrset_thaw(c);
+        assert(::jnp1::encstrset_insert(c, "x", "key"));
+        assert(::jnp1::encstrset_save(c, path));
+        unsigned long loaded = ::jnp1::encstrset_load(path);
+        assert(::jnp1::encstrset_size(loaded) == 6 && ::jnp1::encstrset_test(loaded, "u", "key"));
+        std::remove(path);
+
+        for (unsigned long id: {b, c, flat, loaded}) {
+            ::jnp1::encstrset_delete(id);
+        }
+    }
+
+    // Returns number of elements visited by a cursor over id, checking that each of them is in expected.
+    size_t iterate(unsigned long id, const std::set<std::string>& expected) {
+        ::jnp1::encstrset_iter* iter = ::jnp1::encstrset_iter_begin(id);
+        assert(iter != nullptr);
+        const char* value;
+        size_t length;
+        size_t visited = 0;
+        while (::jnp1::encstrset_iter_next(iter, &value, &length)) {
+            assert(expected.count(std::string(value, length)) == 1);
+            visited++;
+        }
+        assert(!::jnp1::encstrset_iter_next(iter, &value, &length));
+        ::jnp1::encstrset_iter_end(iter);
+        return visited;
+    }
+
+    void testIter() {
+        std::set<std::string> expected;
+        for (int i = 0; i < 100; i++) {
+            expected.insert("value" + std::to_string(i));
+        }
+        expected.insert(std::string("nul\0inside", 10));
+
+        for (bool interned: {false, true}) {
+            unsigned long id = newSet(interned);
+            assert(iterate(id, expected) == 0);
+            for (const std::string& value: expected) {
+                ::jnp1::encstrset_insert_n(id, value.data(), value.size(), nullptr, 0);
+            }
+            assert(iterate(id, expected) == expected.size());
+
+            // Cursor keeps seeing contents from the moment it was opened.
+            ::jnp1::encstrset_iter* iter = ::jnp1::encstrset_iter_begin(id);
+            ::jnp1::encstrset_clear(id);
+            ::jnp1::encstrset_delete(id);
+            size_t visited = 0;
+            while (::jnp1::encstrset_iter_next(iter, nullptr, nullptr)) {
+                visited++;
+            }
+            assert(visited == expected.size());
+            ::jnp1::encstrset_iter_end(iter);
+        }
+
+        unsigned long id = ::jnp1::encstrset_new();
+        for (const std::string& value: expected) {
+            ::jnp1::encstrset_insert_n(id, value.data(), value.size(), nullptr, 0);
+        }
+        assert(::jnp1::encstrset_save(id, path));
+        unsigned long loaded = ::jnp1::encstrset_load(path);
+        assert(iterate(loaded, expected) == expected.size());
+        assert(::jnp1::encstrset_freeze(id));
+        assert(iterate(id, expected) == expected.size());
+        std::remove(path);
+
+        assert(::jnp1::encstrset_iter_begin(ENCSTRSET_NO_SET) == nullptr);
+        ::jnp1::encstrset_delete(id);
+        ::jnp1::encstrset_delete(loaded);
+    }
+
+    void testMemory() {
+        ::jnp1::encstrset_memory_info before, info;
+        ::jnp1::encstrset_memory_stats(&before);
+
+        unsigned long id = ::jnp1::encstrset_new_with_capacity(1000);
+        assert(::jnp1::encstrset_memory_usage(id, &info));
+        size_t reserved = info.index_bytes;
+        assert(info.sets == 1 && info.elements == 0 && reserved > 0);
+        std::string value;
+        for (int i = 0; i < 1000; i++) {
+            value = "a somewhat longer value " + std::to_string(i);
+            ::jnp1::encstrset_insert(id, value.c_str(), "key");
+        }
+        assert(::jnp1::encstrset_memory_usage(id, &info));
+        assert(info.elements == 1000 && info.index_bytes == reserved && info.payload_bytes >= 24000);
+        assert(info.pool_bytes == 0 && info.other_bytes == 0);
+
+        assert(::jnp1::encstrset_reserve(id, 100000));
+        assert(::jnp1::encstrset_memory_usage(id, &info) && info.index_bytes > 50 * reserved);
+        assert(!::jnp1::encstrset_reserve(id + 1, 1));
+
+        // Shared contents are counted once by global statistics.
+        unsigned long copy = ::jnp1::encstrset_new();
+        ::jnp1::encstrset_copy(id, copy);
+        unsigned long interned = ::jnp1::encstrset_new_interned();
+        ::jnp1::encstrset_copy(id, interned);
+        ::jnp1::encstrset_insert(interned, "one more", "key");
+        ::jnp1::encstrset_memory_stats(&info);
+        assert(info.sets == before.sets + 3 && info.elements == before.elements + 3001);
+        assert(info.pool_entries == before.pool_entries + 1001 && info.pool_bytes > before.pool_bytes);
+        assert(info.payload_bytes - before.payload_bytes < 2 * 24000 + 1000 * 8);
+
+        for (unsigned long set: {id, copy, interned}) {
+            ::jnp1::encstrset_delete(set);
+        }
+        ::jnp1::encstrset_memory_stats(&info);
+        assert(info.sets == before.sets && info.pool_entries == before.pool_entries);
+    }
+
+    // Statistics exist only when the library is compiled with -DENCSTRSET_STATS.
+    void testStats() {
+        ::jnp1::encstrset_call_stats stats;
+        ::jnp1::encstrset_stats_reset();
+        if (!::jnp1::encstrset_stats(::jnp1::ENCSTRSET_FN_INSERT, &stats)) {
+            return;
+        }
+        assert(stats.calls == 0);
+        assert(!::jnp1::encstrset_stats(::jnp1::ENCSTRSET_FN_COUNT, &stats));
+
+        unsigned long id = ::jnp1::encstrset_new();
+        assert(::jnp1::encstrset_insert(id, "a", "key"));
+        assert(::jnp1::encstrset_insert_k(id, "a", nullptr));
+        assert(!::jnp1::encstrset_insert(id, "a", "key"));
+        ::jnp1::encstrset_test(id, "a", "key");
+        ::jnp1::encstrset_test(id, "b", "key");
+        ::jnp1::encstrset_test(id, "c", "key");
+        ::jnp1::encstrset_delete(id);
+        ::jnp1::encstrset_delete(id);
+
+        assert(::jnp1::encstrset_stats(::jnp1::ENCSTRSET_FN_INSERT, &stats));
+        assert(stats.calls == 3 && stats.hits == 2 && stats.misses == 1);
+        assert(::jnp1::encstrset_stats(::jnp1::ENCSTRSET_FN_TEST, &stats));
+        assert(stats.calls == 3 && stats.hits == 1);
+        size_t bucketed = 0;
+        for (size_t b = 0; b < ENCSTRSET_LATENCY_BUCKETS; b++) {
+            bucketed += stats.latency[b];
+        }
+        assert(bucketed == 3 && stats.p50_ns <= stats.p99_ns && stats.p99_ns <= stats.p999_ns);
+        assert(::jnp1::encstrset_stats(::jnp1::ENCSTRSET_FN_DELETE, &stats));
+        assert(stats.calls == 2 && stats.hits == 1);
+
+
+        // Variants of encstrset_new() are counted with it.
+        for (unsigned long set: {::jnp1::encstrset_new_interned(), ::jnp1::encstrset_new_ordered(),
+                                 ::jnp1::encstrset_new_with_capacity(10)}) {
+            ::jnp1::encstrset_delete(set);
+        }
+        assert(::jnp1::encstrset_stats(::jnp1::ENCSTRSET_FN_NEW, &stats));
+        assert(stats.calls == 4 && stats.hits == 4);
+
+        ::jnp1::encstrset_stats_reset();
+        assert(::jnp1::encstrset_stats(::jnp1::ENCSTRSET_FN_TEST, &stats) && stats.calls == 0);
+    }
+
+    void testSnapshot() {
+        // Large enough to be split into partitions.
+        const int count = 70000;
+        unsigned long id = ::jnp1::encstrset_new_with_capacity(count);
+        std::string value;
+        for (int i = 0; i < count; i++) {
+            value = "v" + std::to_string(i);
+            ::jnp1::encstrset_insert(id, value.c_str(), nullptr);
+        }
+        assert(::jnp1::encstrset_snapshot(ENCSTRSET_NO_SET) == ENCSTRSET_NO_SET);
+
+        unsigned long before = ::jnp1::encstrset_snapshot(id);
+        assert(::jnp1::encstrset_insert(id, "new", nullptr));
+        assert(::jnp1::encstrset_remove(id, "v0", nullptr));
+        unsigned long after = ::jnp1::encstrset_snapshot(id);
+        ::jnp1::encstrset_clear(id);
+
+        assert(::jnp1::encstrset_size(before) == count && ::jnp1::encstrset_size(after) == count);
+        assert(::jnp1::encstrset_test(before, "v0", nullptr) && !::jnp1::encstrset_test(before, "new", nullptr));
+        assert(!::jnp1::encstrset_test(after, "v0", nullptr) && ::jnp1::encstrset_test(after, "new", nullptr));
+        assert(::jnp1::encstrset_test(after, "v69999", nullptr));
+        assert(!::jnp1::encstrset_insert(before, "other", nullptr));
+        std::set<std::string> all;
+        for (int i = 0; i < count; i++) {
+            all.insert("v" + std::to_string(i));
+        }
+        assert(iterate(before, all) == count);
+
+        // Thawed snapshot is an independent set.
+        ::jnp1::encstrset_thaw(after);
+        assert(::jnp1::encstrset_insert(after, "v0", nullptr));
+        assert(::jnp1::encstrset_size(after) == count + 1 && ::jnp1::encstrset_size(before) == count);
+        assert(::jnp1::encstrset_size(id) == 0);
+
+        for (unsigned long set: {id, before, after}) {
+            ::jnp1::encstrset_delete(set);
+        }
+    }
+
+    void testReclaim() {
+        for (bool deferred: {false, true}) {
+            ::jnp1::encstrset_deferred_reclaim(deferred);
+            unsigned long id = ::jnp1::encstrset_new();
+            unsigned long interned = ::jnp1::encstrset_new_interned();
+            std::string value;
+            for (int i = 0; i < 10000; i++) {
+                value = "r" + std::to_string(i);
+                ::jnp1::encstrset_insert(id, value.c_str(), "key");
+            }
+            ::jnp1::encstrset_copy(id, interned);
+            unsigned long copy = ::jnp1::encstrset_new();
+            ::jnp1::encstrset_copy(id, copy);
+
+            ::jnp1::encstrset_clear(id);
+            assert(::jnp1::encstrset_size(id) == 0 && !::jnp1::encstrset_test(id, "r1", "key"));
+            assert(::jnp1::encstrset_insert(id, "r1", "key"));
+            assert(::jnp1::encstrset_size(copy) == 10000 && ::jnp1::encstrset_test(copy, "r1", "key"));
+            ::jnp1::encstrset_delete(copy);
+            ::jnp1::encstrset_clear(interned);
+            assert(::jnp1::encstrset_size(interned) == 0);
+            ::jnp1::encstrset_delete(id);
+            ::jnp1::encstrset_delete(interned);
+        }
+        ::jnp1::encstrset_deferred_reclaim(false);
+    }
+
+    // Returns cyphertexts visited by a cursor, in order of visiting.
+    std::vector<std::string> scan(::jnp1::encstrset_iter* iter) {
+        assert(iter != nullptr);
+        std::vector<std::string> visited;
+        const char* value;
+        size_t length;
+        while (::jnp1::encstrset_iter_next(iter, &value, &length)) {
+            visited.emplace_back(value, length);
+        }
+        ::jnp1::encstrset_iter_end(iter);
+        return visited;
+    }
+
+    void testOrdered() {
+        // Enough elements, some of them long, for several levels of nodes to be split and then merged.
+        unsigned long id = ::jnp1::encstrset_new_ordered();
+        std::set<std::string> expected;
+        for (int i = 0; i < 20000; i++) {
+            std::string value = std::to_string(i * 7919 % 20000);
+            if (i % 100 == 0) {
+                value += std::string(3000, 'x');
+            }
+            assert(::jnp1::encstrset_insert_n(id, value.data(), value.size(), nullptr, 0));
+            expected.insert(value);
+        }
+        assert(!::jnp1::encstrset_insert(id, "42", nullptr));
+        for (int i = 0; i < 20000; i += 3) {
+            std::string value = std::to_string(i);
+            if (::jnp1::encstrset_remove(id, value.c_str(), nullptr)) {
+                expected.erase(value);
+            }
+        }
+        assert(::jnp1::encstrset_size(id) == expected.size());
+        assert(::jnp1::encstrset_test(id, "1", nullptr) && !::jnp1::encstrset_test(id, "3", nullptr));
+        std::vector<std::string> all = scan(::jnp1::encstrset_iter_begin(id));
+        assert(all == std::vector<std::string>(expected.begin(), expected.end()));
+
+        std::vector<std::string> range = scan(::jnp1::encstrset_iter_range(id, "123", 3, "13", 2, nullptr, 0));
+        assert(range == std::vector<std::string>(expected.lower_bound("123"), expected.lower_bound("13")));
+        std::vector<std::string> prefix = scan(::jnp1::encstrset_iter_prefix(id, "199", 3, nullptr, 0));
+        assert(prefix == std::vector<std::string>(expected.lower_bound("199"), expected.lower_bound("19:")));
+        assert(!prefix.empty());
+        assert(scan(::jnp1::encstrset_iter_range(id, "5", 1, nullptr, 0, nullptr, 0)).size()
+               == (size_t) std::distance(expected.lower_bound("5"), expected.end()));
+
+        // Other kinds answer the same scans, in no particular order.
+        unsigned long flat = ::jnp1::encstrset_new();
+        ::jnp1::encstrset_copy(id, flat);
+        ::jnp1::encstrset_insert(flat, "new", nullptr);
+        std::vector<std::string> unordered = scan(::jnp1::encstrset_iter_prefix(flat, "199", 3, nullptr, 0));
+        assert(std::set<std::string>(unordered.begin(), unordered.end()) == std::set<std::string>(prefix.begin(), prefix.end()));
+
+        // Prefix is encrypted with the key like values are.
+        unsigned long keyed = ::jnp1::encstrset_new_ordered();
+        for (const char* value: {"apple", "apricot", "banana", "ap"}) {
+            ::jnp1::encstrset_insert(keyed, value, "key");
+        }
+        assert(scan(::jnp1::encstrset_iter_prefix(keyed, "ap", 2, "key", 3)).size() == 3);
+        assert(scan(::jnp1::encstrset_iter_prefix(keyed, "ap", 2, nullptr, 0)).empty());
+        assert(scan(::jnp1::encstrset_iter_prefix(keyed, nullptr, 0, nullptr, 0)).size() == 4);
+
+        // Frozen and copied ordered sets stay ordered.
+        assert(::jnp1::encstrset_freeze(id));
+        assert(!::jnp1::encstrset_insert(id, "new", nullptr));
+        assert(scan(::jnp1::encstrset_iter_prefix(id, "199", 3, nullptr, 0)) == prefix);
+        ::jnp1::encstrset_thaw(id);
+        unsigned long copy = ::jnp1::encstrset_new_ordered();
+        ::jnp1::encstrset_copy(flat, copy);
+        expected.insert("new");
+        assert(scan(::jnp1::encstrset_iter_begin(copy)) == std::vector<std::string>(expected.begin(), expected.end()));
+
+        ::jnp1::encstrset_clear(id);
+        assert(::jnp1::encstrset_size(id) == 0 && scan(::jnp1::encstrset_iter_begin(id)).empty());
+        assert(::jnp1::encstrset_iter_prefix(ENCSTRSET_NO_SET, "a", 1, nullptr, 0) == nullptr);
+        for (unsigned long set: {id, flat, keyed, copy}) {
+            ::jnp1::encstrset_delete(set);
+        }
+    }
+
+    // Sets large enough to be partitioned are combined partition by partition. Partitions are shared out among
+    // worker threads only when the library is compiled with NDEBUG, as it is for t3_ndebug.
+    void testBulk() {
+        const int n = 70000;
+        unsigned long a = ::jnp1::encstrset_new();
+        unsigned long b = ::jnp1::encstrset_new();
+        std::string value;
+        for (int i = 0; i < n; i++) {
+            value = "v" + std::to_string(i);
+            ::jnp1::encstrset_insert(a, value.c_str(), "key");
+            value = "v" + std::to_string(i + n / 2);
+            ::jnp1::encstrset_insert(b, value.c_str(), "key");
+        }
+
+        unsigned long u = ::jnp1::encstrset_new();
+        ::jnp1::encstrset_insert(u, "u", "key");
+        ::jnp1::encstrset_copy(a, u);
+        ::jnp1::encstrset_union_into(b, u);
+        assert(::jnp1::encstrset_size(u) == n + n / 2 + 1);
+
+        unsigned long i = ::jnp1::encstrset_new();
+        ::jnp1::encstrset_insert(i, "i", "key");
+        ::jnp1::encstrset_copy(a, i);
+        ::jnp1::encstrset_intersect(b, i);
+        assert(::jnp1::encstrset_size(i) == n / 2);
+        assert(::jnp1::encstrset_test(i, "v69999", "key") && !::jnp1::encstrset_test(i, "v0", "key"));
+
+        ::jnp1::encstrset_difference(a, u);
+        assert(::jnp1::encstrset_size(u) == n / 2 + 1);
+        assert(::jnp1::encstrset_test(u, "v70000", "key") && !::jnp1::encstrset_test(u, "v1", "key"));
+        assert(::jnp1::encstrset_size(a) == n && ::jnp1::encstrset_size(b) == n);
+
+        for (unsigned long set: {a, b, u, i}) {
+            ::jnp1::encstrset_delete(set);
+        }
+    }
+
+    // Removals leave deleted slots behind, so a set kept just below its load limit by alternating insertions and
+    // removals fills up with them. Clearing them out must keep the table from growing without bound, which doubling
+    // it every time it fills up would not.
+    void testChurn() {
+        const int n = 57343; // one less than 7/8 of 65536 slots
+        const int pairs = 100000;
+        unsigned long id = ::jnp1::encstrset_new_with_capacity(n + 1);
+        std::string value;
+        for (int i = 0; i < n; i++) {
+            value = "c" + std::to_string(i);
+            ::jnp1::encstrset_insert(id, value.c_str(), "key");
+        }
+        ::jnp1::encstrset_memory_info info;
+        assert(::jnp1::encstrset_memory_usage(id, &info));
+        size_t filled = info.index_bytes;
+
+        for (int i = 0; i < pairs; i++) {
+            value = "c" + std::to_string(n + i);
+            assert(::jnp1::encstrset_insert(id, value.c_str(), "key"));
+            value = "c" + std::to_string(i);
+            assert(::jnp1::encstrset_remove(id, value.c_str(), "key"));
+        }
+        assert(::jnp1::encstrset_memory_usage(id, &info));
+        assert(info.elements == n && info.index_bytes <= 2 * filled);
+
+        value = "c" + std::to_string(pairs - 1);
+        assert(!::jnp1::encstrset_test(id, value.c_str(), "key"));
+        value = "c" + std::to_string(pairs);
+        assert(::jnp1::encstrset_test(id, value.c_str(), "key"));
+        value = "c" + std::to_string(n + pairs - 1);
+        assert(::jnp1::encstrset_test(id, value.c_str(), "key"));
+        ::jnp1::encstrset_delete(id);
+    }
+}
+
+int main() {
+    testSaveLoad();
+    testCorruptFile();
+    testBloom();
+    testAlgebra(false);
+    testAlgebra(true);
+    testKeys();
+    testBinary();
+    testFreeze();
+    testInterned();
+    testIter();
+    testMemory();
+    testStats();
+    testSnapshot();
+    testReclaim();
+    testOrdered();
+    testBulk();
+    testChurn();
+}
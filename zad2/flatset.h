@@ -0,0 +1,474 @@
+#ifndef FLATSET_H
+#define FLATSET_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include "storage.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace jnp1::detail{
+
+// Deterministic 64-bit hash of a byte string (MurmurHash64A). Values do not depend on the process, so they may be
+// stored together with the data they describe.
+inline uint64_t hashBytes(std::string_view bytes){
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const char* data = bytes.data();
+    size_t length = bytes.size();
+    uint64_t h = 0x9747b28c ^ (length * m);
+
+    for(; length >= 8; data += 8, length -= 8){
+        uint64_t k;
+        std::memcpy(&k, data, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    if(length > 0){
+        uint64_t tail = 0;
+        for(size_t i = length; i-- > 0;){
+            tail = (tail << 8) | (unsigned char) data[i];
+        }
+        h ^= tail;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// Layout of a flat table. Used by FlatSet, which owns its arrays, and by read-only views of tables stored
+// elsewhere, e.g. in mapped files. Arrays are plain data, so they can be copied or written out byte by byte.
+//
+// A table consists of three arrays. Bytes of all elements are stored in the arena, each prefixed with its length.
+// Slots keep only the element's full hash and its offset in the arena. Control bytes hold 7 bits of every
+// element's hash (or mark the slot empty/deleted), which lets a probe skip non-matching slots eight at a time without
+// touching slots or arena. Bytes in the arena are compared only when full hashes match.
+// Slots are grouped by eight. Probing visits whole groups and stops at the first group containing an empty slot.
+struct FlatTable{
+    struct Slot{
+        uint64_t hash;
+        uint64_t offset;
+    };
+
+    using Group = uint64_t;
+
+    static constexpr uint8_t emptyCtrl = 0x80;
+    static constexpr uint8_t deletedCtrl = 0xFE;
+    static constexpr size_t groupWidth = sizeof(Group);
+    static constexpr size_t npos = SIZE_MAX;
+
+    const uint8_t* ctrl = nullptr;
+    const Slot* slots = nullptr;
+    const char* arena = nullptr;
+    size_t capacity = 0;
+
+    static bool isFull(uint8_t c){
+        return c < 0x80;
+    }
+
+    static uint8_t fingerprint(uint64_t h){
+        return h & 0x7F;
+    }
+
+    // Keeps load factor (counting deleted slots) at most 7/8.
+    static size_t maxLoad(size_t capacity){
+        return capacity - capacity / 8;
+    }
+
+    static size_t recordSize(uint32_t length){
+        return sizeof(uint32_t) + length;
+    }
+
+    // Bits set at most significant bits of matching bytes. May report false positives right after a true
+    // match, which is harmless since full hashes are compared anyway.
+    static Group match(Group g, uint8_t c){
+        const Group lsbs = 0x0101010101010101ULL;
+        const Group msbs = 0x8080808080808080ULL;
+        Group x = g ^ (lsbs * c);
+        return (x - lsbs) & ~x & msbs;
+    }
+
+    static Group matchEmpty(Group g){
+        return g & (~g << 6) & 0x8080808080808080ULL;
+    }
+
+    static Group matchEmptyOrDeleted(Group g){
+        return g & 0x8080808080808080ULL;
+    }
+
+    static size_t lowestIndex(Group mask){
+        return __builtin_ctzll(mask) / 8;
+    }
+
+    Group loadGroup(size_t pos) const{
+        Group g;
+        std::memcpy(&g, ctrl + pos, groupWidth);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        g = __builtin_bswap64(g);
+#endif
+        return g;
+    }
+
+    size_t firstGroup(uint64_t h) const{
+        return ((h >> 7) & (capacity - 1)) & ~(groupWidth - 1);
+    }
+
+    size_t nextGroup(size_t pos) const{
+        return (pos + groupWidth) & (capacity - 1);
+    }
+
+    uint32_t lengthAt(uint64_t offset) const{
+        uint32_t length;
+        std::memcpy(&length, arena + offset, sizeof(length));
+        return length;
+    }
+
+    std::string_view at(uint64_t offset) const{
+        return std::string_view(arena + offset + sizeof(uint32_t), lengthAt(offset));
+    }
+
+    // Returns slot holding s or npos.
+    size_t find(std::string_view s, uint64_t h) const{
+        if(capacity == 0){
+            return npos;
+        }
+        uint8_t fp = fingerprint(h);
+        for(size_t pos = firstGroup(h);; pos = nextGroup(pos)){
+            Group g = loadGroup(pos);
+            for(Group m = match(g, fp); m != 0; m &= m - 1){
+                size_t i = pos + lowestIndex(m);
+                if(slots[i].hash == h && at(slots[i].offset) == s){
+                    return i;
+                }
+            }
+            if(matchEmpty(g) != 0){
+                return npos;
+            }
+        }
+    }
+
+    // Returns first empty or deleted slot on probe sequence of h. There always is one thanks to maxLoad().
+    size_t findFree(uint64_t h) const{
+        for(size_t pos = firstGroup(h);; pos = nextGroup(pos)){
+            Group m = matchEmptyOrDeleted(loadGroup(pos));
+            if(m != 0){
+                return pos + lowestIndex(m);
+            }
+        }
+    }
+
+    // Implements SetStorage::next(). Positions are slot indexes, empty slots are skipped a group at a time.
+    bool next(size_t& position, std::string_view& element) const{
+        for(size_t pos = position & ~(groupWidth - 1); pos < capacity; pos += groupWidth){
+            Group full = ~loadGroup(pos) & 0x8080808080808080ULL;
+            if(pos < position){
+                full &= ~Group(0) << ((position - pos) * 8);
+            }
+            if(full != 0){
+                size_t i = pos + lowestIndex(full);
+                element = at(slots[i].offset);
+                position = i + 1;
+                return true;
+            }
+        }
+        position = capacity;
+        return false;
+    }
+
+    // Calls f(element, hash) for every element.
+    template <class F>
+    void forEach(F f) const{
+        for(size_t i = 0; i < capacity; i++){
+            if(isFull(ctrl[i])){
+                f(at(slots[i].offset), slots[i].hash);
+            }
+        }
+    }
+};
+
+// Open-addressing hash set of byte strings owning its flat table (see FlatTable).
+// Erased elements leave garbage in the arena, which is compacted once it outweighs live data.
+class FlatSet final: public SetStorage{
+    public:
+    using Slot = FlatTable::Slot;
+
+    FlatSet() = default;
+
+    // Copies table described by t, which has to hold exactly count elements. Nothing is hashed again.
+    FlatSet(const FlatTable& t, size_t count, size_t arenaSize):
+        ctrl(t.ctrl, t.ctrl + t.capacity), slots(t.slots, t.slots + t.capacity), arena(t.arena, t.arena + arenaSize),
+        count(count) {
+        size_t used = 0;
+        for(uint8_t c: ctrl){
+            used += c != FlatTable::emptyCtrl;
+        }
+        growthLeft = FlatTable::maxLoad(ctrl.size()) - used;
+    }
+
+    static uint64_t hash(std::string_view s){
+        return hashBytes(s);
+    }
+
+    size_t size() const override{
+        return count;
+    }
+
+    bool contains(std::string_view s, uint64_t h) const override{
+        return count != 0 && table().find(s, h) != FlatTable::npos;
+    }
+
+    bool contains(std::string_view s) const{
+        return contains(s, hash(s));
+    }
+
+    bool writable() const override{
+        return true;
+    }
+
+    std::unique_ptr<SetStorage> clone() const override{
+        return std::make_unique<FlatSet>(*this);
+    }
+
+    // Returns true if s was inserted, false if it was already present.
+    bool insert(std::string_view s, uint64_t h) override{
+        if(contains(s, h)){
+            return false;
+        }
+        if(growthLeft == 0){
+            makeRoom();
+        }
+        size_t pos = table().findFree(h);
+        if(ctrl[pos] == FlatTable::emptyCtrl){
+            growthLeft--;
+        }
+        ctrl[pos] = FlatTable::fingerprint(h);
+        slots[pos] = Slot{h, append(s)};
+        count++;
+        return true;
+    }
+
+    bool insert(std::string_view s){
+        return insert(s, hash(s));
+    }
+
+    // Returns true if s was erased, false if it was not present.
+    bool erase(std::string_view s, uint64_t h) override{
+        FlatTable t = table();
+        size_t pos = count == 0 ? FlatTable::npos : t.find(s, h);
+        if(pos == FlatTable::npos){
+            return false;
+        }
+        deadBytes += FlatTable::recordSize(t.lengthAt(slots[pos].offset));
+        // A lookup passing this group would have stopped here if the group had an empty slot, so in that case
+        // the slot can become empty instead of deleted.
+        if(FlatTable::matchEmpty(t.loadGroup(pos & ~(FlatTable::groupWidth - 1))) != 0){
+            ctrl[pos] = FlatTable::emptyCtrl;
+            growthLeft++;
+        } else {
+            ctrl[pos] = FlatTable::deletedCtrl;
+        }
+        count--;
+        if(count == 0){
+            clear();
+        } else if(deadBytes > minCompaction && deadBytes > arena.size() / 2){
+            compact();
+        }
+        return true;
+    }
+
+    bool erase(std::string_view s){
+        return erase(s, hash(s));
+    }
+
+    void clear() override{
+        ctrl.assign(ctrl.size(), FlatTable::emptyCtrl);
+        arena.clear();
+        count = 0;
+        deadBytes = 0;
+        growthLeft = FlatTable::maxLoad(ctrl.size());
+    }
+
+    // Makes room for n elements without further rehashing.
+    void reserve(size_t n) override{
+        if(n > count + growthLeft){
+            rehash(n);
+        }
+    }
+
+    void forEach(const Visitor& visit) const override{
+        table().forEach(visit);
+    }
+
+    bool next(size_t& position, std::string_view& element) const override{
+        return table().next(position, element);
+    }
+
+    // Calls f(element, hash) for every element. Unlike forEach() it can be inlined.
+    template <class F>
+    void forEachInline(F f) const{
+        table().forEach(f);
+    }
+
+    // Read-only view of the table. Invalidated by any modification.
+    FlatTable table() const{
+        return FlatTable{ctrl.data(), slots.data(), arena.data(), ctrl.size()};
+    }
+
+    // Drops arena garbage left by erased elements.
+    void compact(){
+        std::vector<char> old;
+        old.swap(arena);
+        arena.reserve(old.size() - deadBytes);
+        for(size_t i = 0; i < ctrl.size(); i++){
+            if(FlatTable::isFull(ctrl[i])){
+                uint64_t offset = slots[i].offset;
+                uint32_t length;
+                std::memcpy(&length, old.data() + offset, sizeof(length));
+                slots[i].offset = arena.size();
+                arena.insert(arena.end(), old.begin() + offset, old.begin() + offset + FlatTable::recordSize(length));
+            }
+        }
+        deadBytes = 0;
+    }
+
+    size_t arenaSize() const{
+        return arena.size();
+    }
+
+    // Arena is counted with garbage and spare capacity, since both are allocated.
+    void memoryUsage(MemoryUsage& usage) const override{
+        usage.indexBytes += ctrl.capacity() + slots.capacity() * sizeof(Slot);
+        usage.payloadBytes += arena.capacity();
+    }
+
+    private:
+    static constexpr size_t minCompaction = 4096;
+
+    std::vector<uint8_t> ctrl;
+    std::vector<Slot> slots;
+    std::vector<char> arena;
+    size_t count = 0;
+    size_t growthLeft = 0;
+    size_t deadBytes = 0;
+
+    uint64_t append(std::string_view s){
+        uint64_t offset = arena.size();
+        uint32_t length = s.size();
+        arena.insert(arena.end(), (const char*) &length, (const char*) &length + sizeof(length));
+        arena.insert(arena.end(), s.begin(), s.end());
+        return offset;
+    }
+
+    // Rebuilds the table with room for at least n elements. Cached hashes are reused, so no element is hashed
+    // again. Deleted slots disappear in the process.
+    void rehash(size_t n){
+        size_t capacity = 2 * FlatTable::groupWidth;
+        while(FlatTable::maxLoad(capacity) < n){
+            capacity *= 2;
+        }
+        rebuild(capacity);
+    }
+
+    // Called when inserting would exceed the load limit. If deleted slots take half of the limit or more, they are
+    // cleared out at the same capacity, otherwise the capacity doubles. Either way the next rebuild is at least half
+    // the limit of insertions away, so rebuilds take amortized constant time per insertion.
+    void makeRoom(){
+        size_t capacity = ctrl.size();
+        if(capacity == 0){
+            rehash(1);
+        } else if(count <= FlatTable::maxLoad(capacity) / 2){
+            rebuild(capacity);
+        } else {
+            rebuild(2 * capacity);
+        }
+    }
+
+    void rebuild(size_t capacity){
+        std::vector<uint8_t> oldCtrl(capacity, FlatTable::emptyCtrl);
+        std::vector<Slot> oldSlots(capacity);
+        oldCtrl.swap(ctrl);
+        oldSlots.swap(slots);
+
+        FlatTable t = table();
+        for(size_t i = 0; i < oldCtrl.size(); i++){
+            if(FlatTable::isFull(oldCtrl[i])){
+                size_t pos = t.findFree(oldSlots[i].hash);
+                ctrl[pos] = oldCtrl[i];
+                slots[pos] = oldSlots[i];
+            }
+        }
+        growthLeft = FlatTable::maxLoad(capacity) - count;
+    }
+};
+
+// Read-only set viewing a flat table stored elsewhere. Keeps the memory holding the table alive.
+class FlatView final: public SetStorage{
+    public:
+    FlatView(const FlatTable& t, size_t count, size_t arenaSize, std::shared_ptr<const void> memory):
+        t(t), count(count), arenaSize(arenaSize), memory(std::move(memory)) {}
+
+    size_t size() const override{
+        return count;
+    }
+
+    bool contains(std::string_view s, uint64_t h) const override{
+        return t.find(s, h) != FlatTable::npos;
+    }
+
+    void forEach(const Visitor& visit) const override{
+        t.forEach(visit);
+    }
+
+    bool next(size_t& position, std::string_view& element) const override{
+        return t.next(position, element);
+    }
+
+    bool writable() const override{
+        return false;
+    }
+
+    // Copies the table as it is, without rehashing.
+    std::unique_ptr<SetStorage> clone() const override{
+        return std::make_unique<FlatSet>(t, count, arenaSize);
+    }
+
+    bool insert(std::string_view, uint64_t) override{
+        throw std::logic_error("FlatView is read-only");
+    }
+
+    bool erase(std::string_view, uint64_t) override{
+        throw std::logic_error("FlatView is read-only");
+    }
+
+    void clear() override{
+        throw std::logic_error("FlatView is read-only");
+    }
+
+    void reserve(size_t) override{}
+
+    void memoryUsage(MemoryUsage& usage) const override{
+        usage.mappedBytes += t.capacity * (1 + sizeof(FlatTable::Slot)) + arenaSize;
+    }
+
+    private:
+    FlatTable t;
+    size_t count;
+    size_t arenaSize;
+    std::shared_ptr<const void> memory;
+};
+
+}
+
+#endif /* FLATSET_H */
@@ -0,0 +1,230 @@
+#ifndef FROZENSET_H
+#define FROZENSET_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include "flatset.h"
+#include "storage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace jnp1::detail{
+
+// Immutable set indexed with a minimal perfect hash function (hash-and-displace, as in CHD/PTHash).
+//
+// Elements are split into buckets by their hash. Every bucket has a pilot value chosen at build time so that
+// position(hash, pilot) maps elements of all buckets to distinct positions in [0, n). Elements are stored
+// contiguously in position order, so a lookup computes one position and compares one element, and there is
+// no empty space. Per element the index costs about one byte of pilots, one byte of fingerprint, which rejects
+// most absent elements without touching the blob, and four bytes of offset.
+class FrozenSet final: public SetStorage{
+    public:
+    // Builds the index over elements of contents. Throws std::length_error if the elements do not fit in the
+    // layout (4 GiB of bytes) and std::invalid_argument in the astronomically unlikely case of two elements with
+    // equal full hashes.
+    explicit FrozenSet(const SetStorage& contents){
+        size_t n = contents.size();
+        std::vector<Item> items;
+        items.reserve(n);
+        size_t bytes = 0;
+        contents.forEach([&](std::string_view s, uint64_t h){
+            items.push_back(Item{h, s});
+            bytes += s.size();
+        });
+        if(bytes > std::numeric_limits<uint32_t>::max()){
+            throw std::length_error("Set too large to freeze");
+        }
+
+        count = n;
+        bucketCount = std::max<size_t>(1, (n + bucketSize - 1) / bucketSize);
+        pilots.assign(bucketCount, 0);
+        std::vector<size_t> placement = place(items);
+
+        // Elements are laid out in position order.
+        std::vector<const Item*> byPosition(n);
+        for(size_t i = 0; i < n; i++){
+            byPosition[placement[i]] = &items[i];
+        }
+        blob.reserve(bytes);
+        offsets.reserve(n + 1);
+        fingerprints.reserve(n);
+        for(const Item* item: byPosition){
+            offsets.push_back(blob.size());
+            fingerprints.push_back(fingerprint(item->hash));
+            blob.insert(blob.end(), item->bytes.begin(), item->bytes.end());
+        }
+        offsets.push_back(blob.size());
+    }
+
+    size_t size() const override{
+        return count;
+    }
+
+    bool contains(std::string_view s, uint64_t h) const override{
+        if(count == 0){
+            return false;
+        }
+        size_t pos = position(h, pilots[bucketOf(h)]);
+        return fingerprints[pos] == fingerprint(h) && at(pos) == s;
+    }
+
+    // Hashes are not stored, so they are computed again.
+    void forEach(const Visitor& visit) const override{
+        for(size_t i = 0; i < count; i++){
+            std::string_view s = at(i);
+            visit(s, hashBytes(s));
+        }
+    }
+
+    bool next(size_t& position, std::string_view& element) const override{
+        if(position >= count){
+            return false;
+        }
+        element = at(position++);
+        return true;
+    }
+
+    bool writable() const override{
+        return false;
+    }
+
+    std::unique_ptr<SetStorage> clone() const override{
+        auto copy = std::make_unique<FlatSet>();
+        copy->reserve(count);
+        forEach([&](std::string_view s, uint64_t h){
+            copy->insert(s, h);
+        });
+        return copy;
+    }
+
+    bool insert(std::string_view, uint64_t) override{
+        throw std::logic_error("FrozenSet is read-only");
+    }
+
+    bool erase(std::string_view, uint64_t) override{
+        throw std::logic_error("FrozenSet is read-only");
+    }
+
+    void clear() override{
+        throw std::logic_error("FrozenSet is read-only");
+    }
+
+    void reserve(size_t) override{}
+
+    void memoryUsage(MemoryUsage& usage) const override{
+        usage.indexBytes += pilots.capacity() * sizeof(uint32_t) + fingerprints.capacity()
+            + offsets.capacity() * sizeof(uint32_t);
+        usage.payloadBytes += blob.capacity();
+    }
+
+    private:
+    static constexpr size_t bucketSize = 4;
+
+    struct Item{
+        uint64_t hash;
+        std::string_view bytes;
+    };
+
+    size_t count = 0;
+    size_t bucketCount = 0;
+    std::vector<uint32_t> pilots;
+    std::vector<uint8_t> fingerprints;
+    std::vector<uint32_t> offsets;
+    std::vector<char> blob;
+
+    static uint64_t mix(uint64_t x){
+        x ^= x >> 31;
+        x *= 0x7fb5d329728ea185ULL;
+        x ^= x >> 27;
+        x *= 0x81dadef4bc2dd44dULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    // Maps x uniformly to [0, n) without division.
+    static size_t reduce(uint64_t x, size_t n){
+        return (size_t) (((unsigned __int128) x * n) >> 64);
+    }
+
+    static uint8_t fingerprint(uint64_t h){
+        return h >> 56;
+    }
+
+    size_t bucketOf(uint64_t h) const{
+        return reduce(mix(h), bucketCount);
+    }
+
+    size_t position(uint64_t h, uint32_t pilot) const{
+        return reduce(mix(h ^ (pilot * 0x9E3779B97F4A7C15ULL)), count);
+    }
+
+    std::string_view at(size_t pos) const{
+        return std::string_view(blob.data() + offsets[pos], offsets[pos + 1] - offsets[pos]);
+    }
+
+    // Chooses pilots and returns position of every item. Largest buckets are placed first, while the table is still
+    // empty; the remaining small ones need more attempts, but each attempt is cheap.
+    std::vector<size_t> place(const std::vector<Item>& items){
+        size_t n = items.size();
+        std::vector<std::vector<size_t>> buckets(bucketCount);
+        for(size_t i = 0; i < n; i++){
+            buckets[bucketOf(items[i].hash)].push_back(i);
+        }
+        std::vector<size_t> order(bucketCount);
+        for(size_t b = 0; b < bucketCount; b++){
+            order[b] = b;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+            return buckets[a].size() > buckets[b].size();
+        });
+
+        std::vector<bool> taken(n, false);
+        std::vector<size_t> placement(n);
+        std::vector<size_t> candidate;
+        for(size_t b: order){
+            const std::vector<size_t>& bucket = buckets[b];
+            if(bucket.empty()){
+                break;
+            }
+            for(size_t i = 1; i < bucket.size(); i++){
+                for(size_t j = 0; j < i; j++){
+                    if(items[bucket[i]].hash == items[bucket[j]].hash){
+                        throw std::invalid_argument("Hash collision, set cannot be frozen");
+                    }
+                }
+            }
+
+            for(uint32_t pilot = 0;; pilot++){
+                candidate.clear();
+                bool ok = true;
+                for(size_t i: bucket){
+                    size_t pos = position(items[i].hash, pilot);
+                    if(taken[pos] || std::find(candidate.begin(), candidate.end(), pos) != candidate.end()){
+                        ok = false;
+                        break;
+                    }
+                    candidate.push_back(pos);
+                }
+                if(ok){
+                    pilots[b] = pilot;
+                    for(size_t k = 0; k < bucket.size(); k++){
+                        taken[candidate[k]] = true;
+                        placement[bucket[k]] = candidate[k];
+                    }
+                    break;
+                }
+            }
+        }
+        return placement;
+    }
+};
+
+}
+
+#endif /* FROZENSET_H */
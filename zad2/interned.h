@@ -0,0 +1,491 @@
+#ifndef INTERNED_H
+#define INTERNED_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include "storage.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jnp1::detail{
+
+// Global table of cyphertexts shared by all interned sets (see InternedSet). Every distinct cyphertext is stored
+// once, under a 32-bit id, together with its hash and the number of references held by sets. It is dropped when
+// the last reference is released and its id is reused.
+//
+// Entries live in chunks that never move, published through a directory swapped RCU-style like slots of the set
+// registry, so holders of a reference read an entry without locking. Lookups by contents go through an index split
+// into shards by hash, each guarded by its own reader/writer lock.
+class InternPool{
+    public:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    // Never destroyed, so sets destroyed at exit, after function-local statics, can still release their entries.
+    static InternPool& instance(){
+        static InternPool* pool = new InternPool();
+        return *pool;
+    }
+
+    // Returns id of s or none if s is not in the pool. Takes no reference.
+    uint32_t find(std::string_view s, uint64_t h) const{
+        const Shard& shard = shardOf(h);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        return lookup(shard, s, h);
+    }
+
+    // Returns id of s, adding it to the pool if needed, and takes a reference to it.
+    uint32_t acquire(std::string_view s, uint64_t h){
+        Shard& shard = shardOf(h);
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            uint32_t id = lookup(shard, s, h);
+            if(id != none){
+                entry(id).refs.fetch_add(1, std::memory_order_relaxed);
+                return id;
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        uint32_t id = lookup(shard, s, h);
+        if(id != none){
+            entry(id).refs.fetch_add(1, std::memory_order_relaxed);
+            return id;
+        }
+        id = allocate(s, h);
+        index(shard, id, h);
+        return id;
+    }
+
+    // Takes another reference to an entry the caller already holds one to.
+    void retain(uint32_t id){
+        entry(id).refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release(uint32_t id){
+        Entry& e = entry(id);
+        uint32_t refs = e.refs.load(std::memory_order_relaxed);
+        while(refs > 1){
+            if(e.refs.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed)){
+                return;
+            }
+        }
+
+        // Possibly the last reference. New references to an entry that nobody holds are only taken by acquire()
+        // under a shared lock of its shard, so under the exclusive lock the count cannot be raised behind our back.
+        Shard& shard = shardOf(e.hash);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if(e.refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            unindex(shard, id, e.hash);
+            deallocate(id);
+        }
+    }
+
+    // Contents of an entry the caller holds a reference to.
+    std::string_view bytes(uint32_t id) const{
+        return entry(id).bytes;
+    }
+
+    uint64_t hash(uint32_t id) const{
+        return entry(id).hash;
+    }
+
+    // Adds bytes taken by the pool to usage: entries and shard indexes as index, element bytes as payload.
+    // Returns number of entries.
+    size_t memoryUsage(MemoryUsage& usage){
+        for(Shard& shard: shards){
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            usage.indexBytes += shard.ids.capacity() * sizeof(uint32_t);
+        }
+        std::lock_guard<std::mutex> lock(allocMutex);
+        usage.indexBytes += chunks.size() * chunkSize * sizeof(Entry);
+        usage.payloadBytes += payload;
+        return used - freeIds.size();
+    }
+
+    private:
+    struct Entry{
+        uint64_t hash = 0;
+        std::atomic<uint32_t> refs{0};
+        std::string bytes;
+    };
+
+    // Open addressing table of ids of entries whose hashes select the shard, probed linearly from the position
+    // given by the hash.
+    struct alignas(64) Shard{
+        mutable std::shared_mutex mutex;
+        std::vector<uint32_t> ids;
+        size_t count = 0;
+    };
+
+    static constexpr unsigned shardBits = 6;
+    static constexpr unsigned chunkBits = 10;
+    static constexpr size_t chunkSize = size_t(1) << chunkBits;
+
+    using Directory = std::vector<Entry*>;
+
+    Shard shards[size_t(1) << shardBits];
+    std::atomic<const Directory*> directory{nullptr};
+
+    // Guards fields below. Taken only while holding a shard lock, never the other way round.
+    std::mutex allocMutex;
+    std::vector<std::unique_ptr<Entry[]>> chunks;
+    std::vector<std::unique_ptr<Directory>> directories;
+    size_t used = 0;
+    std::vector<uint32_t> freeIds;
+    // Bytes allocated outside of entries for elements too long for the small string buffer.
+    size_t payload = 0;
+
+    InternPool() = default;
+
+    // Shard is selected by the highest bits of the hash, positions inside it by the lowest ones.
+    Shard& shardOf(uint64_t h){
+        return shards[h >> (64 - shardBits)];
+    }
+
+    const Shard& shardOf(uint64_t h) const{
+        return shards[h >> (64 - shardBits)];
+    }
+
+    Entry& entry(uint32_t id) const{
+        const Directory& dir = *directory.load(std::memory_order_acquire);
+        return dir[id >> chunkBits][id & (chunkSize - 1)];
+    }
+
+    // Must be called with shard locked.
+    uint32_t lookup(const Shard& shard, std::string_view s, uint64_t h) const{
+        if(shard.count == 0){
+            return none;
+        }
+        size_t mask = shard.ids.size() - 1;
+        for(size_t i = h & mask;; i = (i + 1) & mask){
+            uint32_t id = shard.ids[i];
+            if(id == none){
+                return none;
+            }
+            const Entry& e = entry(id);
+            if(e.hash == h && e.bytes == s){
+                return id;
+            }
+        }
+    }
+
+    // Must be called with shard locked exclusively.
+    void index(Shard& shard, uint32_t id, uint64_t h){
+        if((shard.count + 1) * 4 > shard.ids.size() * 3){
+            std::vector<uint32_t> old(std::max<size_t>(16, shard.ids.size() * 2), none);
+            old.swap(shard.ids);
+            for(uint32_t other: old){
+                if(other != none){
+                    place(shard, other, entry(other).hash);
+                }
+            }
+        }
+        place(shard, id, h);
+        shard.count++;
+    }
+
+    void place(Shard& shard, uint32_t id, uint64_t h){
+        size_t mask = shard.ids.size() - 1;
+        size_t i = h & mask;
+        while(shard.ids[i] != none){
+            i = (i + 1) & mask;
+        }
+        shard.ids[i] = id;
+    }
+
+    // Removes id with backward shifting, so the table needs no tombstones. Must be called with shard locked
+    // exclusively.
+    void unindex(Shard& shard, uint32_t id, uint64_t h){
+        size_t mask = shard.ids.size() - 1;
+        size_t i = h & mask;
+        while(shard.ids[i] != id){
+            i = (i + 1) & mask;
+        }
+        for(size_t j = (i + 1) & mask; shard.ids[j] != none; j = (j + 1) & mask){
+            size_t home = entry(shard.ids[j]).hash & mask;
+            if(((j - home) & mask) >= ((j - i) & mask)){
+                shard.ids[i] = shard.ids[j];
+                i = j;
+            }
+        }
+        shard.ids[i] = none;
+        shard.count--;
+    }
+
+    // Returns id of a new entry holding one reference.
+    uint32_t allocate(std::string_view s, uint64_t h){
+        std::lock_guard<std::mutex> lock(allocMutex);
+        uint32_t id;
+        if(!freeIds.empty()){
+            id = freeIds.back();
+            freeIds.pop_back();
+        } else {
+            if(used == chunks.size() * chunkSize){
+                if(used >= none){
+                    throw std::length_error("Intern pool is full");
+                }
+                chunks.emplace_back(new Entry[chunkSize]);
+                auto dir = std::make_unique<Directory>();
+                dir->reserve(chunks.size());
+                for(auto& chunk: chunks){
+                    dir->push_back(chunk.get());
+                }
+                directory.store(dir.get(), std::memory_order_release);
+                directories.push_back(std::move(dir));
+            }
+            id = used++;
+        }
+        Entry& e = entry(id);
+        e.hash = h;
+        e.bytes.assign(s);
+        payload += heapBytes(e.bytes);
+        e.refs.store(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    static size_t heapBytes(const std::string& s){
+        return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+    }
+
+    void deallocate(uint32_t id){
+        std::lock_guard<std::mutex> lock(allocMutex);
+        payload -= heapBytes(entry(id).bytes);
+        std::string().swap(entry(id).bytes);
+        freeIds.push_back(id);
+    }
+};
+
+// Set of cyphertexts held in the intern pool, stored as their ids. Elements are compared as integers, so sets
+// built of the same pool can be copied and combined (see forEachId(), insertId(), eraseId() and containsId())
+// without touching any cyphertext. Each element holds one reference to its pool entry.
+class InternedSet final: public SetStorage{
+    public:
+    InternedSet() = default;
+
+    InternedSet(const InternedSet& other):
+        ids(other.ids), count(other.count) {
+        InternPool& pool = InternPool::instance();
+        for(uint32_t id: ids){
+            if(id != none){
+                pool.retain(id);
+            }
+        }
+    }
+
+    InternedSet& operator=(const InternedSet&) = delete;
+
+    ~InternedSet() override{
+        releaseAll();
+    }
+
+    size_t size() const override{
+        return count;
+    }
+
+    // An element absent from the pool is absent from every set, which answers such tests with one pool lookup.
+    bool contains(std::string_view s, uint64_t h) const override{
+        if(count == 0){
+            return false;
+        }
+        uint32_t id = InternPool::instance().find(s, h);
+        return id != none && containsId(id);
+    }
+
+    void forEach(const Visitor& visit) const override{
+        const InternPool& pool = InternPool::instance();
+        for(uint32_t id: ids){
+            if(id != none){
+                visit(pool.bytes(id), pool.hash(id));
+            }
+        }
+    }
+
+    bool next(size_t& position, std::string_view& element) const override{
+        for(; position < ids.size(); position++){
+            if(ids[position] != none){
+                element = InternPool::instance().bytes(ids[position++]);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool writable() const override{
+        return true;
+    }
+
+    std::unique_ptr<SetStorage> clone() const override{
+        return std::make_unique<InternedSet>(*this);
+    }
+
+    bool insert(std::string_view s, uint64_t h) override{
+        InternPool& pool = InternPool::instance();
+        uint32_t id = pool.acquire(s, h);
+        if(!add(id)){
+            pool.release(id);
+            return false;
+        }
+        return true;
+    }
+
+    bool erase(std::string_view s, uint64_t h) override{
+        if(count == 0){
+            return false;
+        }
+        uint32_t id = InternPool::instance().find(s, h);
+        return id != none && eraseId(id);
+    }
+
+    void clear() override{
+        releaseAll();
+        ids.clear();
+        count = 0;
+    }
+
+    void reserve(size_t n) override{
+        if(n * 4 > ids.size() * 3){
+            rehash(n);
+        }
+    }
+
+    // Elements themselves live in the pool, see InternPool::memoryUsage().
+    void memoryUsage(MemoryUsage& usage) const override{
+        usage.indexBytes += ids.capacity() * sizeof(uint32_t);
+    }
+
+    bool containsId(uint32_t id) const{
+        if(count == 0){
+            return false;
+        }
+        for(size_t i = position(id);; i = (i + 1) & mask()){
+            if(ids[i] == id){
+                return true;
+            }
+            if(ids[i] == none){
+                return false;
+            }
+        }
+    }
+
+    // Adds id held by another set. Returns true if it was not present.
+    bool insertId(uint32_t id){
+        if(!add(id)){
+            return false;
+        }
+        InternPool::instance().retain(id);
+        return true;
+    }
+
+    bool eraseId(uint32_t id){
+        if(count == 0){
+            return false;
+        }
+        size_t i = position(id);
+        while(ids[i] != id){
+            if(ids[i] == none){
+                return false;
+            }
+            i = (i + 1) & mask();
+        }
+        for(size_t j = (i + 1) & mask(); ids[j] != none; j = (j + 1) & mask()){
+            size_t home = position(ids[j]);
+            if(((j - home) & mask()) >= ((j - i) & mask())){
+                ids[i] = ids[j];
+                i = j;
+            }
+        }
+        ids[i] = none;
+        count--;
+        InternPool::instance().release(id);
+        return true;
+    }
+
+    template <class Fn>
+    void forEachId(Fn&& fn) const{
+        for(uint32_t id: ids){
+            if(id != none){
+                fn(id);
+            }
+        }
+    }
+
+    private:
+    static constexpr uint32_t none = InternPool::none;
+    static constexpr size_t minCapacity = 8;
+
+    // Power of 2 number of slots, at most 3/4 full, probed linearly. Empty when nothing was inserted.
+    std::vector<uint32_t> ids;
+    size_t count = 0;
+
+    size_t mask() const{
+        return ids.size() - 1;
+    }
+
+    // Ids are allocated densely, so they are mixed (with the finalizer of MurmurHash3) before use. Position is taken
+    // from the lowest bits: tables are iterated in position order, and ids coming in the order of a larger table
+    // then spread evenly over a smaller one, while the highest bits would pile them up in one place.
+    size_t position(uint32_t id) const{
+        uint64_t x = id;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x & mask();
+    }
+
+    // Returns false if id was already present. Takes no reference.
+    bool add(uint32_t id){
+        reserve(count + 1);
+        size_t i = position(id);
+        while(ids[i] != none){
+            if(ids[i] == id){
+                return false;
+            }
+            i = (i + 1) & mask();
+        }
+        ids[i] = id;
+        count++;
+        return true;
+    }
+
+    void rehash(size_t n){
+        size_t capacity = minCapacity;
+        while(n * 4 > capacity * 3){
+            capacity *= 2;
+        }
+        std::vector<uint32_t> old(capacity, none);
+        old.swap(ids);
+        for(uint32_t id: old){
+            if(id != none){
+                size_t i = position(id);
+                while(ids[i] != none){
+                    i = (i + 1) & mask();
+                }
+                ids[i] = id;
+            }
+        }
+    }
+
+    void releaseAll(){
+        InternPool& pool = InternPool::instance();
+        for(uint32_t id: ids){
+            if(id != none){
+                pool.release(id);
+            }
+        }
+    }
+};
+
+}
+
+#endif /* INTERNED_H */
@@ -0,0 +1,292 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+namespace jnp1::detail{
+
+// Messages of level higher than the current one are skipped before anything gets formatted.
+enum class LogLevel: int{
+    off = 0,
+    error = 1,  // invalid arguments, missing sets
+    info = 2,   // results of operations
+    trace = 3,  // function calls
+};
+
+// Wrappers selecting how an argument is printed.
+struct Quoted{
+    const char* s;
+    size_t length;
+};
+
+struct Cypher{
+    std::string_view bytes;
+};
+
+inline Quoted quoted(const char* s){
+    return Quoted{s, s == nullptr ? 0 : std::char_traits<char>::length(s)};
+}
+
+inline Quoted quoted(const char* s, size_t length){
+    return Quoted{s, length};
+}
+
+inline Cypher cypher(std::string_view bytes){
+    return Cypher{bytes};
+}
+
+// Bounded lock-free queue of formatted lines with many producers and one consumer (Vyukov's algorithm).
+// Cells keep their string buffers between laps, so pushing a line does not allocate once buffers have grown.
+class LogRing{
+    public:
+    bool tryPush(const std::string& line){
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for(;;){
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            if(seq == pos){
+                if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    cell.line.assign(line);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(seq < pos){
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Must be called from one thread only. Calls f with the next line, if there is one.
+    template <class F>
+    bool tryPop(F f){
+        Cell& cell = cells[dequeuePos & mask];
+        if(cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1){
+            return false;
+        }
+        f(cell.line);
+        cell.sequence.store(dequeuePos + capacity, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+
+    private:
+    static constexpr size_t capacity = 1024;
+    static constexpr size_t mask = capacity - 1;
+
+    struct Cell{
+        std::atomic<size_t> sequence;
+        std::string line;
+    };
+
+    std::unique_ptr<Cell[]> cells = makeCells();
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) size_t dequeuePos = 0;
+
+    static std::unique_ptr<Cell[]> makeCells(){
+        std::unique_ptr<Cell[]> c(new Cell[capacity]);
+        for(size_t i = 0; i < capacity; i++){
+            c[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        return c;
+    }
+};
+
+// Writes diagnostic lines to std::cerr from a background thread. Callers only format the line and push it to
+// the ring, so they never wait for the stream. Level comes from ENCSTRSET_LOG_LEVEL (0-3, all messages by
+// default) and can be changed at any time. Lines left in the ring are written when the logger is destroyed at exit.
+class Logger{
+    public:
+    static Logger& instance(){
+        static Logger logger;
+        return logger;
+    }
+
+    bool enabled(LogLevel l) const{
+        return (int) l <= level.load(std::memory_order_relaxed);
+    }
+
+    void setLevel(int l){
+        level.store(l, std::memory_order_relaxed);
+    }
+
+    void push(const std::string& line){
+        // A full ring means the drainer fell behind. Lines are never dropped, the producer waits instead.
+        while(!ring.tryPush(line)){
+            wake();
+            std::this_thread::yield();
+        }
+        if(idle.load(std::memory_order_acquire)){
+            wake();
+        }
+    }
+
+    ~Logger(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        drainer.join();
+    }
+
+    private:
+    LogRing ring;
+    std::atomic<int> level{initialLevel()};
+    std::atomic<bool> idle{false};
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+    std::thread drainer;
+
+    Logger(){
+        // Makes sure std::cerr outlives the logger.
+        static std::ios_base::Init init;
+        drainer = std::thread([this]{ drain(); });
+    }
+
+    static int initialLevel(){
+        const char* env = std::getenv("ENCSTRSET_LOG_LEVEL");
+        return env != nullptr ? std::atoi(env) : (int) LogLevel::trace;
+    }
+
+    void wake(){
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeup.notify_one();
+    }
+
+    void drain(){
+        auto write = [](const std::string& line){
+            std::cerr.write(line.data(), line.size());
+        };
+        for(;;){
+            bool any = false;
+            while(ring.tryPop(write)){
+                any = true;
+            }
+            if(any){
+                std::cerr.flush();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if(stopping){
+                // Producers are gone, but one could have pushed right before stopping was set.
+                lock.unlock();
+                while(ring.tryPop(write)){}
+                std::cerr.flush();
+                return;
+            }
+            idle.store(true, std::memory_order_release);
+            // Timeout covers a producer that pushed right before idle was set.
+            wakeup.wait_for(lock, std::chrono::milliseconds(10));
+            idle.store(false, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Formatting of single arguments.
+
+inline void appendArg(std::string& out, std::string_view s){
+    out += s;
+}
+
+inline void appendArg(std::string& out, const char* s){
+    out += s;
+}
+
+inline void appendArg(std::string& out, Quoted q){
+    if(q.s == nullptr){
+        out += "NULL";
+    } else {
+        out += '"';
+        out.append(q.s, q.length);
+        out += '"';
+    }
+}
+
+inline void appendArg(std::string& out, Cypher c){
+    static const char digits[] = "0123456789ABCDEF";
+    out += '"';
+    for(size_t i = 0; i < c.bytes.size(); i++){
+        unsigned char b = c.bytes[i];
+        if(i > 0){
+            out += ' ';
+        }
+        out += digits[b >> 4];
+        out += digits[b & 0xF];
+    }
+    out += '"';
+}
+
+template <class T, class = std::enable_if_t<std::is_integral_v<T>>>
+void appendArg(std::string& out, T value){
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+// Recursive formatting of argument lists, separated with sep.
+inline void appendArgs(std::string&, std::string_view){}
+
+template <class T, class... Ts>
+void appendArgs(std::string& out, std::string_view sep, T current, Ts... rest){
+    appendArg(out, current);
+    if(sizeof...(rest) > 0){
+        out += sep;
+    }
+    appendArgs(out, sep, rest...);
+}
+
+// Line buffer of the calling thread. Reused, so formatting does not allocate once it has grown.
+inline std::string& lineBuffer(){
+    thread_local std::string line;
+    line.clear();
+    return line;
+}
+
+// Writes concatenation of args as one line.
+template <class... Ts>
+void logLine(LogLevel level, Ts... args){
+    Logger& logger = Logger::instance();
+    if(!logger.enabled(level)){
+        return;
+    }
+    std::string& line = lineBuffer();
+    appendArgs(line, "", args...);
+    line += '\n';
+    logger.push(line);
+}
+
+// Writes line of form functionName(arg1, arg2, ...) at trace level.
+template <class... Ts>
+void logCall(std::string_view functionName, Ts... args){
+    Logger& logger = Logger::instance();
+    if(!logger.enabled(LogLevel::trace)){
+        return;
+    }
+    std::string& line = lineBuffer();
+    line += functionName;
+    line += '(';
+    appendArgs(line, ", ", args...);
+    line += ")\n";
+    logger.push(line);
+}
+
+}
+
+#endif /* LOGGING_H */
@@ -0,0 +1,498 @@
+#ifndef ORDERED_H
+#define ORDERED_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include "flatset.h"
+#include "storage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jnp1::detail{
+
+// Set kept in byte order (as compared by memcmp), as a B+-tree. Next to membership it finds the first element not
+// less than a given string, which is what range and prefix scans start from, and walks on from there leaf by leaf.
+//
+// Leaves pack their elements one after another into a single buffer, so a search inside a leaf stays within two
+// contiguous arrays. Inner nodes keep separators, where separator i is not greater than any element under child
+// i + 1 and greater than every element under child i, and the number of elements under every child. Counts let
+// positions of SetStorage::next() be plain ranks, which it descends to comparing nothing.
+// All leaves are at the same depth (height). Nodes are merged with a neighbour once they shrink to a quarter
+// of their capacity and the two fit in one node.
+class OrderedSet final: public SetStorage{
+    public:
+    OrderedSet():
+        root(std::make_unique<Node>()) {}
+
+    // Builds the tree bottom-up from sorted elements of contents. Nodes are filled to three quarters, leaving room
+    // for inserts.
+    explicit OrderedSet(const SetStorage& contents){
+        std::vector<std::string_view> elements;
+        elements.reserve(contents.size());
+        contents.forEach([&](std::string_view s, uint64_t){
+            elements.push_back(s);
+        });
+        std::sort(elements.begin(), elements.end());
+        build(elements);
+    }
+
+    OrderedSet(const OrderedSet& other):
+        root(copyNode(*other.root)), height(other.height), count(other.count) {}
+
+    size_t size() const override{
+        return count;
+    }
+
+    bool contains(std::string_view s, uint64_t) const override{
+        const Node* node = root.get();
+        for(unsigned level = height; level > 0; level--){
+            node = node->children[childOf(*node, s)].get();
+        }
+        size_t i = lowerBound(*node, s);
+        return i < node->ends.size() && element(*node, i) == s;
+    }
+
+    // Visits elements in order. Hashes are not stored, so they are computed again.
+    void forEach(const Visitor& visit) const override{
+        visitNode(*root, height, visit);
+    }
+
+    // Position is the rank of the next element, so elements come in order. Every step descends from the root;
+    // scans use Cursor instead.
+    bool next(size_t& position, std::string_view& element) const override{
+        if(position >= count){
+            return false;
+        }
+        element = at(position++);
+        return true;
+    }
+
+    private:
+    struct Node;
+
+    public:
+    // Place in the tree: the inner nodes on the path from the root, each with the index of the child taken, and
+    // the leaf and the index of the next element in it. Valid as long as the set is not modified, which holds for
+    // contents shared with a cursor (see mutableSet()).
+    struct Cursor{
+        std::vector<std::pair<const Node*, size_t>> path;
+        const Node* leaf = nullptr;
+        size_t index = 0;
+    };
+
+    // Returns a cursor at the first element not less than s.
+    Cursor seek(std::string_view s) const{
+        Cursor cursor;
+        const Node* node = root.get();
+        for(unsigned level = height; level > 0; level--){
+            size_t c = childOf(*node, s);
+            cursor.path.emplace_back(node, c);
+            node = node->children[c].get();
+        }
+        cursor.leaf = node;
+        cursor.index = lowerBound(*node, s);
+        return cursor;
+    }
+
+    // Stores the element at cursor in element and moves the cursor past it, or returns false if there are no more
+    // elements. Once a leaf is done, the cursor climbs only as far as the first node with a child left to visit,
+    // so a scan takes amortized constant time per element.
+    bool next(Cursor& cursor, std::string_view& element) const{
+        while(cursor.index == cursor.leaf->ends.size()){
+            while(!cursor.path.empty() && cursor.path.back().second + 1 == cursor.path.back().first->children.size()){
+                cursor.path.pop_back();
+            }
+            if(cursor.path.empty()){
+                return false;
+            }
+            const Node* node = cursor.path.back().first->children[++cursor.path.back().second].get();
+            while(cursor.path.size() < height){
+                cursor.path.emplace_back(node, 0);
+                node = node->children[0].get();
+            }
+            cursor.leaf = node;
+            cursor.index = 0;
+        }
+        element = OrderedSet::element(*cursor.leaf, cursor.index++);
+        return true;
+    }
+
+    bool writable() const override{
+        return true;
+    }
+
+    std::unique_ptr<SetStorage> clone() const override{
+        return std::make_unique<OrderedSet>(*this);
+    }
+
+    bool insert(std::string_view s, uint64_t) override{
+        std::string separator;
+        std::unique_ptr<Node> sibling;
+        if(!insertInto(*root, height, s, separator, sibling)){
+            return false;
+        }
+        count++;
+        if(sibling != nullptr){
+            auto newRoot = std::make_unique<Node>();
+            newRoot->counts = {nodeSize(*root, height), nodeSize(*sibling, height)};
+            newRoot->separators.push_back(std::move(separator));
+            newRoot->children.push_back(std::move(root));
+            newRoot->children.push_back(std::move(sibling));
+            root = std::move(newRoot);
+            height++;
+        }
+        return true;
+    }
+
+    bool erase(std::string_view s, uint64_t) override{
+        if(!eraseFrom(*root, height, s)){
+            return false;
+        }
+        count--;
+        while(height > 0 && root->children.size() == 1){
+            root = std::move(root->children[0]);
+            height--;
+        }
+        return true;
+    }
+
+    void clear() override{
+        root = std::make_unique<Node>();
+        height = 0;
+        count = 0;
+    }
+
+    // The tree grows a node at a time, there is nothing to allocate ahead.
+    void reserve(size_t) override{}
+
+    void memoryUsage(MemoryUsage& usage) const override{
+        addMemoryUsage(*root, usage);
+    }
+
+    private:
+    static constexpr size_t maxChildren = 64;
+    static constexpr size_t maxLeafElements = 128;
+    static constexpr size_t maxLeafBytes = 4096;
+
+    struct Node{
+        // Inner nodes.
+        std::vector<std::string> separators;
+        std::vector<std::unique_ptr<Node>> children;
+        std::vector<size_t> counts;
+        // Leaves: element i takes bytes from ends[i - 1] (0 for the first one) to ends[i].
+        std::vector<char> bytes;
+        std::vector<size_t> ends;
+    };
+
+    std::unique_ptr<Node> root;
+    unsigned height = 0;
+    size_t count = 0;
+
+    static std::string_view element(const Node& leaf, size_t i){
+        size_t begin = i == 0 ? 0 : leaf.ends[i - 1];
+        return std::string_view(leaf.bytes.data() + begin, leaf.ends[i] - begin);
+    }
+
+    // Index of the first element of leaf not less than s.
+    static size_t lowerBound(const Node& leaf, std::string_view s){
+        size_t low = 0;
+        size_t high = leaf.ends.size();
+        while(low < high){
+            size_t middle = (low + high) / 2;
+            if(element(leaf, middle) < s){
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    // Index of the child of inner node whose subtree may hold s.
+    static size_t childOf(const Node& node, std::string_view s){
+        return std::upper_bound(node.separators.begin(), node.separators.end(), s,
+            [](std::string_view a, const std::string& b){ return a < b; }) - node.separators.begin();
+    }
+
+    static size_t nodeSize(const Node& node, unsigned level){
+        if(level == 0){
+            return node.ends.size();
+        }
+        size_t result = 0;
+        for(size_t c: node.counts){
+            result += c;
+        }
+        return result;
+    }
+
+    std::string_view at(size_t rank) const{
+        const Node* node = root.get();
+        for(unsigned level = height; level > 0; level--){
+            size_t c = 0;
+            while(rank >= node->counts[c]){
+                rank -= node->counts[c++];
+            }
+            node = node->children[c].get();
+        }
+        return element(*node, rank);
+    }
+
+    static std::unique_ptr<Node> copyNode(const Node& node){
+        auto copy = std::make_unique<Node>();
+        copy->separators = node.separators;
+        copy->counts = node.counts;
+        copy->bytes = node.bytes;
+        copy->ends = node.ends;
+        copy->children.reserve(node.children.size());
+        for(const auto& child: node.children){
+            copy->children.push_back(copyNode(*child));
+        }
+        return copy;
+    }
+
+    static void visitNode(const Node& node, unsigned level, const Visitor& visit){
+        if(level == 0){
+            for(size_t i = 0; i < node.ends.size(); i++){
+                std::string_view s = element(node, i);
+                visit(s, hashBytes(s));
+            }
+            return;
+        }
+        for(const auto& child: node.children){
+            visitNode(*child, level - 1, visit);
+        }
+    }
+
+    static void addMemoryUsage(const Node& node, MemoryUsage& usage){
+        static const size_t inlineCapacity = std::string().capacity();
+        usage.indexBytes += sizeof(Node) + node.separators.capacity() * sizeof(std::string)
+            + node.children.capacity() * sizeof(node.children[0]) + node.counts.capacity() * sizeof(size_t)
+            + node.ends.capacity() * sizeof(size_t);
+        for(const std::string& separator: node.separators){
+            if(separator.capacity() > inlineCapacity){
+                usage.indexBytes += separator.capacity() + 1;
+            }
+        }
+        usage.payloadBytes += node.bytes.capacity();
+        for(const auto& child: node.children){
+            addMemoryUsage(*child, usage);
+        }
+    }
+
+    // Leaves holding a single element are never split, however long the element is.
+    static bool overfull(const Node& leaf){
+        return leaf.ends.size() > maxLeafElements || (leaf.bytes.size() > maxLeafBytes && leaf.ends.size() > 1);
+    }
+
+    static bool underfull(const Node& node, unsigned level){
+        if(level == 0){
+            return node.ends.size() <= maxLeafElements / 4 && node.bytes.size() <= maxLeafBytes / 4;
+        }
+        return node.children.size() <= maxChildren / 4;
+    }
+
+    static void insertElement(Node& leaf, size_t i, std::string_view s){
+        size_t begin = i == 0 ? 0 : leaf.ends[i - 1];
+        leaf.bytes.insert(leaf.bytes.begin() + begin, s.begin(), s.end());
+        leaf.ends.insert(leaf.ends.begin() + i, begin);
+        for(size_t j = i; j < leaf.ends.size(); j++){
+            leaf.ends[j] += s.size();
+        }
+    }
+
+    static void removeElement(Node& leaf, size_t i){
+        size_t begin = i == 0 ? 0 : leaf.ends[i - 1];
+        size_t length = leaf.ends[i] - begin;
+        leaf.bytes.erase(leaf.bytes.begin() + begin, leaf.bytes.begin() + leaf.ends[i]);
+        leaf.ends.erase(leaf.ends.begin() + i);
+        for(size_t j = i; j < leaf.ends.size(); j++){
+            leaf.ends[j] -= length;
+        }
+    }
+
+    // Moves upper half of leaf, by bytes, to a new sibling and stores its first element in separator.
+    static void splitLeaf(Node& leaf, std::string& separator, std::unique_ptr<Node>& sibling){
+        size_t n = leaf.ends.size();
+        size_t half = std::upper_bound(leaf.ends.begin(), leaf.ends.end(), leaf.bytes.size() / 2) - leaf.ends.begin();
+        half = std::clamp<size_t>(half, 1, n - 1);
+        size_t offset = leaf.ends[half - 1];
+
+        sibling = std::make_unique<Node>();
+        sibling->bytes.assign(leaf.bytes.begin() + offset, leaf.bytes.end());
+        sibling->ends.reserve(n - half);
+        for(size_t j = half; j < n; j++){
+            sibling->ends.push_back(leaf.ends[j] - offset);
+        }
+        leaf.bytes.resize(offset);
+        leaf.ends.resize(half);
+        separator = std::string(element(*sibling, 0));
+    }
+
+    // Moves upper half of children of inner node to a new sibling. The separator between the halves moves up.
+    static void splitInner(Node& node, std::string& separator, std::unique_ptr<Node>& sibling){
+        size_t half = node.children.size() / 2;
+        sibling = std::make_unique<Node>();
+        sibling->children.assign(std::make_move_iterator(node.children.begin() + half),
+                                 std::make_move_iterator(node.children.end()));
+        sibling->counts.assign(node.counts.begin() + half, node.counts.end());
+        sibling->separators.assign(std::make_move_iterator(node.separators.begin() + half),
+                                   std::make_move_iterator(node.separators.end()));
+        separator = std::move(node.separators[half - 1]);
+        node.children.resize(half);
+        node.counts.resize(half);
+        node.separators.resize(half - 1);
+    }
+
+    // Inserts s into subtree of node. When node overflows, its upper half is moved to sibling and the separator
+    // of the two is stored in separator, both to be added to the parent.
+    static bool insertInto(Node& node, unsigned level, std::string_view s, std::string& separator,
+                           std::unique_ptr<Node>& sibling){
+        if(level == 0){
+            size_t i = lowerBound(node, s);
+            if(i < node.ends.size() && element(node, i) == s){
+                return false;
+            }
+            insertElement(node, i, s);
+            if(overfull(node)){
+                splitLeaf(node, separator, sibling);
+            }
+            return true;
+        }
+
+        size_t c = childOf(node, s);
+        std::string childSeparator;
+        std::unique_ptr<Node> childSibling;
+        if(!insertInto(*node.children[c], level - 1, s, childSeparator, childSibling)){
+            return false;
+        }
+        node.counts[c]++;
+        if(childSibling != nullptr){
+            size_t moved = nodeSize(*childSibling, level - 1);
+            node.counts[c] -= moved;
+            node.counts.insert(node.counts.begin() + c + 1, moved);
+            node.children.insert(node.children.begin() + c + 1, std::move(childSibling));
+            node.separators.insert(node.separators.begin() + c, std::move(childSeparator));
+            if(node.children.size() > maxChildren){
+                splitInner(node, separator, sibling);
+            }
+        }
+        return true;
+    }
+
+    static bool eraseFrom(Node& node, unsigned level, std::string_view s){
+        if(level == 0){
+            size_t i = lowerBound(node, s);
+            if(i == node.ends.size() || element(node, i) != s){
+                return false;
+            }
+            removeElement(node, i);
+            return true;
+        }
+
+        size_t c = childOf(node, s);
+        if(!eraseFrom(*node.children[c], level - 1, s)){
+            return false;
+        }
+        node.counts[c]--;
+        if(underfull(*node.children[c], level - 1)){
+            if(c + 1 < node.children.size() && fits(*node.children[c], *node.children[c + 1], level - 1)){
+                merge(node, c, level - 1);
+            } else if(c > 0 && fits(*node.children[c - 1], *node.children[c], level - 1)){
+                merge(node, c - 1, level - 1);
+            }
+        }
+        return true;
+    }
+
+    static bool fits(const Node& left, const Node& right, unsigned level){
+        if(level == 0){
+            return left.ends.empty() || right.ends.empty() || (left.ends.size() + right.ends.size() <= maxLeafElements
+                && left.bytes.size() + right.bytes.size() <= maxLeafBytes);
+        }
+        return left.children.size() + right.children.size() <= maxChildren;
+    }
+
+    // Merges child c + 1 of node into child c. Children are at given level.
+    static void merge(Node& node, size_t c, unsigned level){
+        Node& left = *node.children[c];
+        Node& right = *node.children[c + 1];
+        if(level == 0){
+            size_t offset = left.bytes.size();
+            left.bytes.insert(left.bytes.end(), right.bytes.begin(), right.bytes.end());
+            for(size_t end: right.ends){
+                left.ends.push_back(offset + end);
+            }
+        } else {
+            left.separators.push_back(std::move(node.separators[c]));
+            left.separators.insert(left.separators.end(), std::make_move_iterator(right.separators.begin()),
+                                   std::make_move_iterator(right.separators.end()));
+            left.children.insert(left.children.end(), std::make_move_iterator(right.children.begin()),
+                                 std::make_move_iterator(right.children.end()));
+            left.counts.insert(left.counts.end(), right.counts.begin(), right.counts.end());
+        }
+        node.counts[c] += node.counts[c + 1];
+        node.counts.erase(node.counts.begin() + c + 1);
+        node.children.erase(node.children.begin() + c + 1);
+        node.separators.erase(node.separators.begin() + c);
+    }
+
+    // Subtree under construction by build(), with its smallest element.
+    struct Built{
+        std::unique_ptr<Node> node;
+        std::string_view first;
+        size_t count;
+    };
+
+    void build(const std::vector<std::string_view>& elements){
+        const size_t leafElements = maxLeafElements * 3 / 4;
+        const size_t leafBytes = maxLeafBytes * 3 / 4;
+        const size_t innerChildren = maxChildren * 3 / 4;
+
+        std::vector<Built> level;
+        for(size_t i = 0; i < elements.size();){
+            auto leaf = std::make_unique<Node>();
+            size_t first = i;
+            while(i < elements.size() && leaf->ends.size() < leafElements
+                  && (leaf->ends.empty() || leaf->bytes.size() + elements[i].size() <= leafBytes)){
+                leaf->bytes.insert(leaf->bytes.end(), elements[i].begin(), elements[i].end());
+                leaf->ends.push_back(leaf->bytes.size());
+                i++;
+            }
+            level.push_back(Built{std::move(leaf), elements[first], i - first});
+        }
+
+        height = 0;
+        count = elements.size();
+        while(level.size() > 1){
+            std::vector<Built> parents;
+            for(size_t i = 0; i < level.size();){
+                auto node = std::make_unique<Node>();
+                size_t first = i;
+                size_t total = 0;
+                // The last node would rather take a few more children than be left with a single one.
+                size_t end = level.size() - i <= innerChildren + 1 ? level.size() : i + innerChildren;
+                for(; i < end; i++){
+                    if(i > first){
+                        node->separators.emplace_back(level[i].first);
+                    }
+                    node->counts.push_back(level[i].count);
+                    node->children.push_back(std::move(level[i].node));
+                    total += level[i].count;
+                }
+                parents.push_back(Built{std::move(node), level[first].first, total});
+            }
+            level = std::move(parents);
+            height++;
+        }
+        root = level.empty() ? std::make_unique<Node>() : std::move(level[0].node);
+    }
+};
+
+}
+
+#endif /* ORDERED_H */
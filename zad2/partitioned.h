@@ -0,0 +1,230 @@
+#ifndef PARTITIONED_H
+#define PARTITIONED_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include "flatset.h"
+#include "storage.h"
+#include "workers.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace jnp1::detail{
+
+// Flat set split by hash into partitions, each of them a FlatSet shared copy-on-write. A copy of the set copies only
+// pointers to partitions and a partition is copied right before its first modification, so a set and its copies
+// share every partition none of them has modified since. Copying a set of n elements and modifying one of the copies
+// costs O(partitionCount + n / partitionCount) instead of O(n). Growth rehashes one partition at a time, too.
+// Partitions never share an element, so bulk operations on two partitioned sets (insertAll(), eraseAll(),
+// assignFiltered()) work on every partition independently, on all threads of the WorkerPool.
+class PartitionedSet final: public SetStorage{
+    public:
+    static constexpr unsigned partitionBits = 8;
+    static constexpr size_t partitionCount = size_t(1) << partitionBits;
+
+    PartitionedSet():
+        partitions(partitionCount) {
+        for(auto& partition: partitions){
+            partition = std::make_shared<FlatSet>();
+        }
+    }
+
+    // Splits elements of contents, reusing their hashes.
+    explicit PartitionedSet(const SetStorage& contents):
+        partitions(partitionCount) {
+        size_t expected = contents.size() / partitionCount;
+        for(auto& partition: partitions){
+            partition = std::make_shared<FlatSet>();
+            partition->reserve(expected + expected / 4);
+        }
+        contents.forEach([&](std::string_view s, uint64_t h){
+            partitions[partitionOf(h)]->insert(s, h);
+        });
+        count = contents.size();
+    }
+
+    size_t size() const override{
+        return count;
+    }
+
+    bool contains(std::string_view s, uint64_t h) const override{
+        return partitions[partitionOf(h)]->contains(s, h);
+    }
+
+    void forEach(const Visitor& visit) const override{
+        for(const auto& partition: partitions){
+            partition->forEach(visit);
+        }
+    }
+
+    // Position keeps the partition in its highest bits and the position inside the partition in the remaining ones.
+    bool next(size_t& position, std::string_view& element) const override{
+        if(position == finished){
+            return false;
+        }
+        for(size_t p = position >> innerBits; p < partitionCount; p++){
+            size_t inner = (p == position >> innerBits) ? position & innerMask : 0;
+            if(partitions[p]->next(inner, element)){
+                position = (p << innerBits) | inner;
+                return true;
+            }
+        }
+        position = finished;
+        return false;
+    }
+
+    bool writable() const override{
+        return true;
+    }
+
+    // Shares all partitions with the copy.
+    std::unique_ptr<SetStorage> clone() const override{
+        return std::make_unique<PartitionedSet>(*this);
+    }
+
+    bool insert(std::string_view s, uint64_t h) override{
+        size_t p = partitionOf(h);
+        if(partitions[p]->contains(s, h)){
+            return false;
+        }
+        mutablePartition(p).insert(s, h);
+        count++;
+        return true;
+    }
+
+    bool erase(std::string_view s, uint64_t h) override{
+        size_t p = partitionOf(h);
+        if(!partitions[p]->contains(s, h)){
+            return false;
+        }
+        mutablePartition(p).erase(s, h);
+        count--;
+        return true;
+    }
+
+    void clear() override{
+        for(auto& partition: partitions){
+            partition = std::make_shared<FlatSet>();
+        }
+        count = 0;
+    }
+
+    void reserve(size_t n) override{
+        if(n <= count){
+            return;
+        }
+        size_t expected = n / partitionCount;
+        for(size_t p = 0; p < partitionCount; p++){
+            if(partitions[p]->size() < expected + expected / 4){
+                mutablePartition(p).reserve(expected + expected / 4);
+            }
+        }
+    }
+
+    // Adds all elements of other. Partitions empty so far are shared with other instead of filled.
+    void insertAll(const PartitionedSet& other){
+        std::vector<size_t> added(partitionCount);
+        WorkerPool::instance().run(partitionCount, [&](size_t p){
+            const auto& source = other.partitions[p];
+            if(source->empty() || source == partitions[p]){
+                return;
+            }
+            if(partitions[p]->empty()){
+                partitions[p] = source;
+                added[p] = source->size();
+                return;
+            }
+            FlatSet& target = mutablePartition(p);
+            size_t before = target.size();
+            target.reserve(before + source->size());
+            source->forEach([&](std::string_view s, uint64_t h){
+                target.insert(s, h);
+            });
+            added[p] = target.size() - before;
+        });
+        for(size_t n: added){
+            count += n;
+        }
+    }
+
+    // Removes all elements of other.
+    void eraseAll(const PartitionedSet& other){
+        std::vector<size_t> removed(partitionCount);
+        WorkerPool::instance().run(partitionCount, [&](size_t p){
+            const FlatSet& source = *other.partitions[p];
+            if(source.empty() || partitions[p]->empty()){
+                return;
+            }
+            size_t before = partitions[p]->size();
+            source.forEach([&](std::string_view s, uint64_t h){
+                if(partitions[p]->contains(s, h)){
+                    mutablePartition(p).erase(s, h);
+                }
+            });
+            removed[p] = before - partitions[p]->size();
+        });
+        for(size_t n: removed){
+            count -= n;
+        }
+    }
+
+    // Replaces contents with elements of other for which keep(element, hash) returns true. Keep is called
+    // concurrently.
+    template <class Keep>
+    void assignFiltered(const PartitionedSet& other, const Keep& keep){
+        std::vector<size_t> kept(partitionCount);
+        WorkerPool::instance().run(partitionCount, [&](size_t p){
+            auto target = std::make_shared<FlatSet>();
+            other.partitions[p]->forEach([&](std::string_view s, uint64_t h){
+                if(keep(s, h)){
+                    target->insert(s, h);
+                }
+            });
+            kept[p] = target->size();
+            partitions[p] = std::move(target);
+        });
+        count = 0;
+        for(size_t n: kept){
+            count += n;
+        }
+    }
+
+    // Partitions shared with copies are counted in full.
+    void memoryUsage(MemoryUsage& usage) const override{
+        usage.indexBytes += partitions.capacity() * sizeof(partitions[0]);
+        for(const auto& partition: partitions){
+            partition->memoryUsage(usage);
+        }
+    }
+
+    private:
+    static constexpr unsigned innerBits = sizeof(size_t) * 8 - partitionBits;
+    static constexpr size_t innerMask = (size_t(1) << innerBits) - 1;
+    static constexpr size_t finished = SIZE_MAX;
+
+    std::vector<std::shared_ptr<FlatSet>> partitions;
+    size_t count = 0;
+
+    // Partition is selected by the highest bits of the hash, which flat tables never use.
+    static size_t partitionOf(uint64_t h){
+        return h >> (64 - partitionBits);
+    }
+
+    FlatSet& mutablePartition(size_t p){
+        if(partitions[p].use_count() > 1){
+            partitions[p] = std::make_shared<FlatSet>(*partitions[p]);
+        } else {
+            // Pairs with the release done by the last other owner dropping its reference.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *partitions[p];
+    }
+};
+
+}
+
+#endif /* PARTITIONED_H */
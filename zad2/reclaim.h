@@ -0,0 +1,83 @@
+#ifndef RECLAIM_H
+#define RECLAIM_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include "storage.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace jnp1::detail{
+
+// Frees contents of sets on a background thread, so that dropping a large set costs its owner one queue push.
+// Contents are handed over as shared pointers, so any other holders (copies, snapshots, cursors) keep them alive
+// as usual and the thread merely drops one reference. Contents still queued are freed when the reclaimer is
+// destroyed at exit.
+class Reclaimer{
+    public:
+    static Reclaimer& instance(){
+        static Reclaimer reclaimer;
+        return reclaimer;
+    }
+
+    void retire(std::shared_ptr<SetStorage> contents){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(contents));
+        }
+        wakeup.notify_one();
+    }
+
+    ~Reclaimer(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        worker.join();
+    }
+
+    private:
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::vector<std::shared_ptr<SetStorage>> queue;
+    bool stopping = false;
+    std::thread worker;
+
+    Reclaimer(){
+        worker = std::thread([this]{ run(); });
+#ifdef SCHED_IDLE
+        // Freeing is never urgent. Woken at normal priority, the thread could preempt the caller that has just
+        // handed it contents and free them before the caller returns.
+        sched_param param{};
+        pthread_setschedparam(worker.native_handle(), SCHED_IDLE, &param);
+#endif
+    }
+
+    void run(){
+        std::vector<std::shared_ptr<SetStorage>> batch;
+        for(;;){
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this]{ return stopping || !queue.empty(); });
+                if(queue.empty()){
+                    return;
+                }
+                batch.swap(queue);
+            }
+            // Contents are freed without holding the mutex, so producers never wait for it.
+            batch.clear();
+        }
+    }
+};
+
+}
+
+#endif /* RECLAIM_H */
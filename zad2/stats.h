@@ -0,0 +1,159 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace jnp1::detail{
+
+// Counters of calls of one function. Bucket b of latency counts calls that took [2^b, 2^(b+1)) nanoseconds
+// (the first one also takes 0 and 1, the last one everything longer).
+struct CallCounters{
+    static constexpr size_t latencyBuckets = 32;
+
+    uint64_t calls = 0;
+    uint64_t hits = 0;
+    uint64_t latency[latencyBuckets] = {};
+
+    void add(const CallCounters& other){
+        calls += other.calls;
+        hits += other.hits;
+        for(size_t b = 0; b < latencyBuckets; b++){
+            latency[b] += other.latency[b];
+        }
+    }
+
+    void subtract(const CallCounters& other){
+        calls -= other.calls;
+        hits -= other.hits;
+        for(size_t b = 0; b < latencyBuckets; b++){
+            latency[b] -= other.latency[b];
+        }
+    }
+
+    static size_t bucketOf(uint64_t nanoseconds){
+        size_t b = 63 - __builtin_clzll(nanoseconds | 1);
+        return b < latencyBuckets ? b : latencyBuckets - 1;
+    }
+};
+
+// Counters of all functions updated by one thread. Only the owner writes them, so an update is a plain load and
+// store of a relaxed atomic, with no read-modify-write and no cache line shared with other threads. Other threads
+// only read them.
+template <size_t functions>
+class ThreadCounters{
+    public:
+    void record(size_t function, bool hit, uint64_t nanoseconds){
+        Counters& c = counters[function];
+        bump(c.calls, 1);
+        bump(c.hits, hit);
+        bump(c.latency[CallCounters::bucketOf(nanoseconds)], 1);
+    }
+
+    void read(size_t function, CallCounters& out) const{
+        const Counters& c = counters[function];
+        CallCounters values;
+        values.calls = c.calls.load(std::memory_order_relaxed);
+        values.hits = c.hits.load(std::memory_order_relaxed);
+        for(size_t b = 0; b < CallCounters::latencyBuckets; b++){
+            values.latency[b] = c.latency[b].load(std::memory_order_relaxed);
+        }
+        out.add(values);
+    }
+
+    private:
+    struct Counters{
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> latency[CallCounters::latencyBuckets] = {};
+    };
+
+    alignas(64) Counters counters[functions];
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t n){
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+// Registry of counters of all threads. Counters of exited threads are folded into retired. Resetting does not touch
+// counters, which threads update without synchronization, but remembers their totals to subtract them later.
+template <size_t functions>
+class CallStats{
+    public:
+    using Counters = ThreadCounters<functions>;
+
+    // Never destroyed, so threads exiting after static destructors have run can still unregister.
+    static CallStats& instance(){
+        static CallStats* stats = new CallStats();
+        return *stats;
+    }
+
+    // Counters of the calling thread, registered on first use.
+    static Counters& local(){
+        thread_local Registration registration;
+        return registration.counters;
+    }
+
+    // Totals of all threads since the last reset.
+    CallCounters totals(size_t function){
+        std::lock_guard<std::mutex> lock(mutex);
+        CallCounters result = retired[function];
+        for(const Counters* counters: threads){
+            counters->read(function, result);
+        }
+        result.subtract(baseline[function]);
+        return result;
+    }
+
+    void reset(){
+        std::lock_guard<std::mutex> lock(mutex);
+        for(size_t f = 0; f < functions; f++){
+            CallCounters current = retired[f];
+            for(const Counters* counters: threads){
+                counters->read(f, current);
+            }
+            baseline[f] = current;
+        }
+    }
+
+    private:
+    struct Registration{
+        Counters counters;
+
+        Registration(){
+            CallStats& stats = instance();
+            std::lock_guard<std::mutex> lock(stats.mutex);
+            stats.threads.push_back(&counters);
+        }
+
+        ~Registration(){
+            CallStats& stats = instance();
+            std::lock_guard<std::mutex> lock(stats.mutex);
+            for(size_t f = 0; f < functions; f++){
+                counters.read(f, stats.retired[f]);
+            }
+            for(size_t i = 0; i < stats.threads.size(); i++){
+                if(stats.threads[i] == &counters){
+                    stats.threads[i] = stats.threads.back();
+                    stats.threads.pop_back();
+                    break;
+                }
+            }
+        }
+    };
+
+    std::mutex mutex;
+    std::vector<const Counters*> threads;
+    CallCounters retired[functions];
+    CallCounters baseline[functions];
+
+    CallStats() = default;
+};
+
+}
+
+#endif /* STATS_H */
@@ -0,0 +1,67 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+namespace jnp1::detail{
+
+// Bytes taken by representations of sets (see SetStorage::memoryUsage()).
+struct MemoryUsage{
+    size_t indexBytes = 0;   // hash index: control bytes, slots, perfect hash data, tables of ids
+    size_t payloadBytes = 0; // stored elements
+    size_t mappedBytes = 0;  // memory mapped from files, resident only when paged in
+};
+
+// Representation of contents of one set. Elements are cyphertexts, each passed together with its hash
+// (see hashBytes()), so a cyphertext is hashed once per call no matter how many representations look at it.
+class SetStorage{
+    public:
+    using Visitor = std::function<void(std::string_view element, uint64_t hash)>;
+
+    virtual ~SetStorage() = default;
+
+    virtual size_t size() const = 0;
+
+    virtual bool contains(std::string_view s, uint64_t hash) const = 0;
+
+    // Calls visit for every element.
+    virtual void forEach(const Visitor& visit) const = 0;
+
+    // Iteration driven by the caller. Starting from position 0, stores the next element in element, advances
+    // position past it and returns true, or returns false when there are no more elements. Positions and elements
+    // stay valid as long as the set is not modified.
+    virtual bool next(size_t& position, std::string_view& element) const = 0;
+
+    // Read-only representations (e.g. views of mapped files) return false. Mutating methods below may be called
+    // only on writable representations, other ones have to be replaced with their clone() first.
+    virtual bool writable() const = 0;
+
+    // Returns a writable copy.
+    virtual std::unique_ptr<SetStorage> clone() const = 0;
+
+    // Return true if set was modified.
+    virtual bool insert(std::string_view s, uint64_t hash) = 0;
+    virtual bool erase(std::string_view s, uint64_t hash) = 0;
+
+    virtual void clear() = 0;
+
+    // Makes room for n elements.
+    virtual void reserve(size_t n) = 0;
+
+    // Adds bytes allocated by the representation to usage. Memory shared with other representations (e.g. pooled
+    // elements of interned sets) is not counted.
+    virtual void memoryUsage(MemoryUsage& usage) const = 0;
+
+    bool empty() const{
+        return size() == 0;
+    }
+};
+
+}
+
+#endif /* STORAGE_H */
@@ -0,0 +1,118 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+// Internal header of the encstrset module. Not a part of its interface.
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jnp1::detail{
+
+// Threads sharing the tasks of bulk operations on large sets, one thread per core besides the caller. They are
+// started on first use and sleep between jobs.
+class WorkerPool{
+    public:
+    using Task = std::function<void(size_t)>;
+
+    static WorkerPool& instance(){
+        static WorkerPool pool;
+        return pool;
+    }
+
+    // Calls task(i) for every i from 0 to tasks - 1, on the calling thread and on all workers, and returns once every
+    // call has returned. Calls may run concurrently and in any order. The pool runs one job at a time; a job started
+    // while it is busy runs on its caller alone, rather than waiting.
+    void run(size_t tasks, const Task& task){
+        std::unique_lock<std::mutex> jobLock(jobMutex, std::try_to_lock);
+        if(!jobLock.owns_lock() || workers.empty() || tasks < 2){
+            for(size_t i = 0; i < tasks; i++){
+                task(i);
+            }
+            return;
+        }
+
+        Job job{task, tasks};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &job;
+            generation++;
+        }
+        wakeup.notify_all();
+        work(job);
+
+        // All tasks are taken, but workers may still be running theirs.
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]{ return job.workers == 0; });
+        current = nullptr;
+    }
+
+    ~WorkerPool(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for(std::thread& worker: workers){
+            worker.join();
+        }
+    }
+
+    private:
+    struct Job{
+        const Task& task;
+        size_t tasks;
+        std::atomic<size_t> next{0};
+        // Workers that joined the job and have not left it yet, guarded by mutex.
+        size_t workers = 0;
+    };
+
+    std::mutex jobMutex;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable done;
+    Job* current = nullptr;
+    unsigned long generation = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    WorkerPool(){
+        unsigned cores = std::thread::hardware_concurrency();
+        for(unsigned i = 1; i < cores; i++){
+            workers.emplace_back([this]{ loop(); });
+        }
+    }
+
+    static void work(Job& job){
+        for(size_t i; (i = job.next.fetch_add(1, std::memory_order_relaxed)) < job.tasks;){
+            job.task(i);
+        }
+    }
+
+    void loop(){
+        unsigned long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;){
+            wakeup.wait(lock, [&]{ return stopping || (current != nullptr && generation != seen); });
+            if(stopping){
+                return;
+            }
+            seen = generation;
+            Job& job = *current;
+            job.workers++;
+            lock.unlock();
+            work(job);
+            lock.lock();
+            if(--job.workers == 0){
+                done.notify_all();
+            }
+        }
+    }
+};
+
+}
+
+#endif /* WORKERS_H */
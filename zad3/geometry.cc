@@ -1,5 +1,8 @@
 #include "geometry.h"
 
+#include <algorithm>
+#include <queue>
+#include <set>
 #include <stdexcept>
 #include <iostream>
 
@@ -18,6 +21,99 @@ namespace{
         }
         return a + b;
     }
+
+    // Coordinates of a collection are processed in blocks of lanes, by loops of fixed length which the compiler
+    // turns into vector instructions.
+    const size_t lanes = 8;
+
+    // Corner coordinate kept as stored modulo 2^32 with offset added.
+    int32_t shifted(uint32_t stored, uint32_t offset){
+        return stored + offset;
+    }
+
+    uint32_t unshifted(int32_t coordinate, uint32_t offset){
+        return (uint32_t) coordinate - offset;
+    }
+
+    // Stores the least and the greatest of shifted coords, which must not be empty, in lowest and highest.
+    void extentOf(const std::vector<uint32_t>& coords, uint32_t offset, int32_t& lowest, int32_t& highest){
+        int32_t low[lanes], high[lanes];
+        std::fill(low, low + lanes, INT32_MAX);
+        std::fill(high, high + lanes, INT32_MIN);
+        size_t i = 0;
+        for(; i + lanes <= coords.size(); i += lanes){
+            for(size_t j = 0; j < lanes; j++){
+                int32_t c = shifted(coords[i + j], offset);
+                low[j] = std::min(low[j], c);
+                high[j] = std::max(high[j], c);
+            }
+        }
+        lowest = *std::min_element(low, low + lanes);
+        highest = *std::max_element(high, high + lanes);
+        for(; i < coords.size(); i++){
+            lowest = std::min(lowest, shifted(coords[i], offset));
+            highest = std::max(highest, shifted(coords[i], offset));
+        }
+    }
+
+    // Throws if translating coordinates from lowest to highest by d overflows. Only the one farthest in
+    // the direction of d can overflow.
+    void checkTranslation(int32_t lowest, int32_t highest, int32_t d){
+        overflowCheckAdd(d > 0 ? highest : lowest, d);
+    }
+
+    // Whether shifted coordinates of a and b are equal.
+    bool sameCoordinates(const std::vector<uint32_t>& a, uint32_t aOffset, const std::vector<uint32_t>& b,
+                         uint32_t bOffset){
+        uint32_t difference = bOffset - aOffset;
+        for(size_t i = 0; i < a.size(); i++){
+            if(a[i] - b[i] != difference){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Unsigned number of 128 bits kept in two halves. Areas and squared distances spanning 2^33 on both axes do
+    // not fit in 64 bits, but need only sums, differences and comparisons of such products.
+    struct Wide{
+        uint64_t high, low;
+
+        Wide operator+(const Wide& w) const{
+            uint64_t sum = low + w.low;
+            return Wide{high + w.high + (sum < low), sum};
+        }
+
+        // Requires w not greater.
+        Wide operator-(const Wide& w) const{
+            return Wide{high - w.high - (low < w.low), low - w.low};
+        }
+
+        bool operator==(const Wide& w) const{
+            return high == w.high && low == w.low;
+        }
+
+        bool operator!=(const Wide& w) const{
+            return !(*this == w);
+        }
+
+        bool operator<(const Wide& w) const{
+            return high != w.high ? high < w.high : low < w.low;
+        }
+
+        bool operator>(const Wide& w) const{
+            return w < *this;
+        }
+    };
+
+    // Exact product, from products of 32-bit halves.
+    inline Wide multiply(uint64_t a, uint64_t b){
+        uint64_t a0 = a & UINT32_MAX, a1 = a >> 32, b0 = b & UINT32_MAX, b1 = b >> 32;
+        uint64_t lowest = a0 * b0;
+        uint64_t middle = a1 * b0 + (lowest >> 32);
+        uint64_t cross = a0 * b1 + (middle & UINT32_MAX);
+        return Wide{a1 * b1 + (middle >> 32) + (cross >> 32), (cross << 32) | (lowest & UINT32_MAX)};
+    }
 }
 
 
@@ -152,7 +248,7 @@ const Position& Rectangle::pos() const{
 }
 
 uint64_t Rectangle::area() const{
-    return widthn * heightn;
+    return (uint64_t) widthn * heightn;
 }
 
 Rectangle Rectangle::reflection() const{
@@ -192,54 +288,245 @@ bool Rectangle::connectRight(const Rectangle& rect){
 
 
 
-// class Rectangless
+// class Rectangles::Reference
 
-Rectangles::Rectangles(std::initializer_list<Rectangle> rectangles): storage(rectangles) {};
+Rectangles::Reference::Reference(Rectangles& owner, size_t index): owner(owner), index(index) {};
 
-Rectangles::Rectangles(): storage() {};
-
-Rectangles::Rectangles(Rectangles &&rectangles) : storage(move(rectangles.storage)) {}
+Rectangles::Reference& Rectangles::Reference::operator=(const Reference& ref){
+    return *this = Rectangle(ref);
+}
 
-Rectangles &Rectangles::operator=(Rectangles &&r) {
-    storage = move(r.storage);
+Rectangles::Reference& Rectangles::Reference::operator=(const Rectangle& rect){
+    owner.set(index, rect);
     return *this;
 }
 
-Rectangle& Rectangles::operator[](size_t i){
-    if(i >= storage.size()){
+Rectangles::Reference::operator Rectangle() const{
+    return owner.get(index);
+}
+
+uint32_t Rectangles::Reference::width() const{
+    return owner.widths[index];
+}
+
+uint32_t Rectangles::Reference::height() const{
+    return owner.heights[index];
+}
+
+Position Rectangles::Reference::pos() const{
+    return Position(shifted(owner.xs[index], owner.dx), shifted(owner.ys[index], owner.dy));
+}
+
+uint64_t Rectangles::Reference::area() const{
+    return Rectangle(*this).area();
+}
+
+Rectangle Rectangles::Reference::reflection() const{
+    return Rectangle(*this).reflection();
+}
+
+bool Rectangles::Reference::operator==(const Rectangle& rect) const{
+    return Rectangle(*this) == rect;
+}
+
+Rectangles::Reference& Rectangles::Reference::operator+=(const Vector& vec){
+    return *this = Rectangle(*this) + vec;
+}
+
+Rectangle Rectangles::Reference::operator+(const Vector& vec) const{
+    return Rectangle(*this) + vec;
+}
+
+
+
+// class Rectangles
+
+Rectangles::Rectangles(std::initializer_list<Rectangle> rectangles): Rectangles() {
+    xs.reserve(rectangles.size());
+    ys.reserve(rectangles.size());
+    widths.reserve(rectangles.size());
+    heights.reserve(rectangles.size());
+    for(const Rectangle& r: rectangles){
+        xs.push_back(r.pos().x());
+        ys.push_back(r.pos().y());
+        widths.push_back(r.width());
+        heights.push_back(r.height());
+        extend(r.pos());
+    }
+};
+
+Rectangles::Rectangles(): dx(0), dy(0), minX(INT32_MAX), maxX(INT32_MIN), minY(INT32_MAX), maxY(INT32_MIN),
+    extentStale(false) {};
+
+void Rectangles::checkIndex(size_t i) const{
+    if(i >= size()){
         throw std::invalid_argument("Rectangle index out of bounds");
     }
-    return storage[i];
 }
 
-const Rectangle& Rectangles::operator[](size_t i) const{
-    if(i >= storage.size()){
-        throw std::invalid_argument("Rectangle index out of bounds");
+Rectangle Rectangles::get(size_t i) const{
+    return Rectangle(widths[i], heights[i], Position(shifted(xs[i], dx), shifted(ys[i], dy)));
+}
+
+// Replacing a rectangle on the boundary of the extent may shrink it, which is left for recomputeExtent().
+void Rectangles::set(size_t i, const Rectangle& rect){
+    int32_t x = shifted(xs[i], dx);
+    int32_t y = shifted(ys[i], dy);
+    if(x == minX || x == maxX || y == minY || y == maxY){
+        extentStale = true;
     }
-    return storage[i];
+    xs[i] = unshifted(rect.pos().x(), dx);
+    ys[i] = unshifted(rect.pos().y(), dy);
+    widths[i] = rect.width();
+    heights[i] = rect.height();
+    extend(rect.pos());
+}
+
+void Rectangles::extend(const Position& corner){
+    minX = std::min(minX, corner.x());
+    maxX = std::max(maxX, corner.x());
+    minY = std::min(minY, corner.y());
+    maxY = std::max(maxY, corner.y());
+}
+
+void Rectangles::recomputeExtent(){
+    extentOf(xs, dx, minX, maxX);
+    extentOf(ys, dy, minY, maxY);
+    extentStale = false;
+}
+
+Rectangles::Reference Rectangles::operator[](size_t i){
+    checkIndex(i);
+    return Reference(*this, i);
+}
+
+Rectangle Rectangles::operator[](size_t i) const{
+    checkIndex(i);
+    return get(i);
 }
 
 size_t Rectangles::size() const{
-    return storage.size();
+    return xs.size();
 }
 
-bool Rectangles::operator==(const Rectangles& rects) const{
-    size_t s = size();
-    if(s != rects.size()){
-        return false;
+namespace{
+    // Segment tree over the gaps between consecutive ys, telling how much of them is covered by at least one
+    // interval added and not yet removed.
+    class CoverTree{
+    public:
+        explicit CoverTree(const std::vector<int64_t>& ys): ys(ys), count(4 * ys.size()), covered(4 * ys.size()){}
+
+        // Adds (delta 1) or removes (delta -1) the interval between ys[from] and ys[to].
+        void update(size_t from, size_t to, int delta){
+            update(1, 0, ys.size() - 1, from, to, delta);
+        }
+
+        uint64_t length() const{
+            return covered[1];
+        }
+
+    private:
+        const std::vector<int64_t>& ys;
+        std::vector<int> count;
+        std::vector<uint64_t> covered;
+
+        // Node covers the gaps between ys[low] and ys[high].
+        void update(size_t node, size_t low, size_t high, size_t from, size_t to, int delta){
+            if(to <= low || high <= from){
+                return;
+            }
+            if(from <= low && high <= to){
+                count[node] += delta;
+            } else{
+                size_t middle = (low + high) / 2;
+                update(2 * node, low, middle, from, to, delta);
+                update(2 * node + 1, middle, high, from, to, delta);
+            }
+            if(count[node] > 0){
+                covered[node] = ys[high] - ys[low];
+            } else if(high - low == 1){
+                covered[node] = 0;
+            } else{
+                covered[node] = covered[2 * node] + covered[2 * node + 1];
+            }
+        }
+    };
+
+    // Left or right edge of a rectangle met by the sweep line of Rectangles::union_area().
+    struct SweepEvent{
+        int64_t x;
+        size_t from, to;
+        int delta;
+
+        bool operator<(const SweepEvent& event) const{
+            return x < event.x;
+        }
+    };
+}
+
+// Sweeps a vertical line across the rectangles, keeping the covered part of it in a segment tree over their
+// distinct y coordinates, and adds up the area swept between consecutive edges.
+uint64_t Rectangles::union_area() const{
+    if(size() == 0){
+        return 0;
     }
-    for(size_t i = 0; i < s; i++){
-        if(!(storage[i] == rects[i])){
-            return false;
+    std::vector<int64_t> bounds;
+    for(size_t i = 0; i < size(); i++){
+        int64_t y = shifted(ys[i], dy);
+        bounds.push_back(y);
+        bounds.push_back(y + heights[i]);
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    std::vector<SweepEvent> events;
+    for(size_t i = 0; i < size(); i++){
+        int64_t x = shifted(xs[i], dx);
+        int64_t y = shifted(ys[i], dy);
+        size_t from = std::lower_bound(bounds.begin(), bounds.end(), y) - bounds.begin();
+        size_t to = std::lower_bound(bounds.begin(), bounds.end(), y + heights[i]) - bounds.begin();
+        events.push_back({x, from, to, 1});
+        events.push_back({x + widths[i], from, to, -1});
+    }
+    std::sort(events.begin(), events.end());
+
+    // Spans up to 2^33 on both axes, so the area needs more than 64 bits until it is checked.
+    Wide area{0, 0};
+    CoverTree tree(bounds);
+    for(size_t i = 0; i < events.size(); i++){
+        if(i > 0){
+            area = area + multiply(tree.length(), events[i].x - events[i - 1].x);
         }
+        tree.update(events[i].from, events[i].to, events[i].delta);
     }
-    return true;
+    if(area.high != 0){
+        throw std::invalid_argument("Area overflow");
+    }
+    return area.low;
 }
 
+bool Rectangles::operator==(const Rectangles& rects) const{
+    return widths == rects.widths && heights == rects.heights && sameCoordinates(xs, dx, rects.xs, rects.dx)
+        && sameCoordinates(ys, dy, rects.ys, rects.dy);
+}
+
+// Takes constant time, unless the extent has to be recomputed first. Both coordinates are checked before any is
+// changed, so an overflow leaves the collection intact.
 Rectangles& Rectangles::operator+=(const Vector& vec){
-    for(Rectangle& r: storage){
-        r += vec;
+    if(size() == 0){
+        return *this;
     }
+    if(extentStale){
+        recomputeExtent();
+    }
+    checkTranslation(minX, maxX, vec.x());
+    checkTranslation(minY, maxY, vec.y());
+    minX += vec.x();
+    maxX += vec.x();
+    minY += vec.y();
+    maxY += vec.y();
+    dx += vec.x();
+    dy += vec.y();
     return *this;
 }
     
@@ -285,3 +572,548 @@ Rectangle merge_all(const Rectangles& rectangles){
     }
     return ret;
 }
+
+
+namespace{
+    // Finds the order of merges for merge_unordered(). Rectangles merge into one exactly if some line cuts them
+    // into two groups that do, and then any such line will do, so the planner cuts the collection until single
+    // rectangles are left and merges the parts back in reverse. Cuts are looked for from all four sides at once,
+    // which costs time proportional to the smaller part; only that part is split off into a new group.
+    class MergePlanner{
+    public:
+        explicit MergePlanner(const Rectangles& rectangles){
+            for(size_t i = 0; i < rectangles.size(); i++){
+                Rectangle rect = rectangles[i];
+                pieces.push_back(rect);
+                low[0].push_back(rect.pos().x());
+                low[1].push_back(rect.pos().y());
+                high[0].push_back(low[0].back() + rect.width());
+                high[1].push_back(low[1].back() + rect.height());
+            }
+        }
+
+        Rectangle merge(){
+            std::vector<size_t> all(pieces.size());
+            for(size_t i = 0; i < all.size(); i++){
+                all[i] = i;
+            }
+            return merge(group(all));
+        }
+
+    private:
+        typedef std::set<std::pair<int64_t, size_t>> Order;
+
+        // Rectangles ordered by lower and by upper coordinates along both axes (x is axis 0, y is axis 1).
+        struct Group{
+            Order byLow[2], byHigh[2];
+
+            size_t size() const{
+                return byLow[0].size();
+            }
+        };
+
+        // Rectangles on the lower or upper side of a line across the given axis.
+        struct Cut{
+            std::vector<size_t> side;
+            unsigned axis;
+            bool lower;
+        };
+
+        std::vector<Rectangle> pieces;
+        std::vector<int64_t> low[2], high[2];
+
+        Group group(const std::vector<size_t>& members) const{
+            Group ret;
+            for(size_t piece: members){
+                for(unsigned axis = 0; axis < 2; axis++){
+                    ret.byLow[axis].emplace(low[axis][piece], piece);
+                    ret.byHigh[axis].emplace(high[axis][piece], piece);
+                }
+            }
+            return ret;
+        }
+
+        void remove(Group& from, size_t piece) const{
+            for(unsigned axis = 0; axis < 2; axis++){
+                from.byLow[axis].erase({low[axis][piece], piece});
+                from.byHigh[axis].erase({high[axis][piece], piece});
+            }
+        }
+
+        template <class Iterator>
+        static std::vector<size_t> prefix(Iterator it, size_t length){
+            std::vector<size_t> ret;
+            for(; length > 0; length--, ++it){
+                ret.push_back(it->second);
+            }
+            return ret;
+        }
+
+        // Scans the group from its four sides, one rectangle from each side in turn, until the rectangles passed
+        // on one side all end before the next one begins.
+        bool findCut(const Group& from, Cut& cut) const{
+            Order::const_iterator up[2] = {from.byLow[0].begin(), from.byLow[1].begin()};
+            Order::const_reverse_iterator down[2] = {from.byHigh[0].rbegin(), from.byHigh[1].rbegin()};
+            int64_t reach[2] = {INT64_MIN, INT64_MIN};
+            int64_t floor[2] = {INT64_MAX, INT64_MAX};
+            for(size_t passed = 1; passed < from.size(); passed++){
+                for(unsigned axis = 0; axis < 2; axis++){
+                    reach[axis] = std::max(reach[axis], high[axis][up[axis]->second]);
+                    if(reach[axis] <= (++up[axis])->first){
+                        cut = {prefix(from.byLow[axis].begin(), passed), axis, true};
+                        return true;
+                    }
+                    floor[axis] = std::min(floor[axis], low[axis][down[axis]->second]);
+                    if(floor[axis] >= (++down[axis])->first){
+                        cut = {prefix(from.byHigh[axis].rbegin(), passed), axis, false};
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        Rectangle merge(Group rest){
+            std::vector<Cut> cuts;
+            std::vector<Rectangle> parts;
+            while(rest.size() > 1){
+                Cut cut;
+                if(!findCut(rest, cut)){
+                    throw std::invalid_argument("Rectangle collection non-mergable");
+                }
+                for(size_t piece: cut.side){
+                    remove(rest, piece);
+                }
+                parts.push_back(merge(group(cut.side)));
+                cuts.push_back(std::move(cut));
+            }
+
+            Rectangle ret = pieces[rest.byLow[0].begin()->second];
+            for(size_t i = parts.size(); i-- > 0;){
+                const Rectangle& lower = cuts[i].lower ? parts[i] : ret;
+                const Rectangle& upper = cuts[i].lower ? ret : parts[i];
+                ret = cuts[i].axis == 0 ? merge_vertically(lower, upper) : merge_horizontally(lower, upper);
+            }
+            return ret;
+        }
+    };
+}
+
+Rectangle merge_unordered(const Rectangles& rectangles){
+    if(rectangles.size() == 0){
+        throw std::invalid_argument("Cannot merge empty collection of rectangles");
+    }
+    return MergePlanner(rectangles).merge();
+}
+
+
+
+// class RectangleIndex
+
+namespace{
+    const size_t maxEntries = 16;
+    const size_t minEntries = 6;
+
+    // Position of (x, y) along the Hilbert curve filling the 2^32 x 2^32 grid.
+    uint64_t hilbertKey(uint32_t x, uint32_t y){
+        uint64_t key = 0;
+        for(uint32_t s = 1u << 31; s > 0; s >>= 1){
+            uint32_t rx = (x & s) != 0;
+            uint32_t ry = (y & s) != 0;
+            key += (uint64_t) s * s * ((3 * rx) ^ ry);
+            if(ry == 0){
+                if(rx == 1){
+                    x = ~x;
+                    y = ~y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return key;
+    }
+
+    // Maps doubled centre coordinate 2x + w, which lies in [-2^32, 2^33), to the Hilbert grid.
+    uint32_t gridCoordinate(int64_t doubledCentre){
+        return (doubledCentre + (int64_t(1) << 32)) >> 2;
+    }
+}
+
+struct RectangleIndex::Box{
+    int64_t xlo, ylo, xhi, yhi;
+
+    bool operator==(const Box& box) const;
+    bool contains(const Box& box) const;
+    bool intersects(const Box& box) const;
+    Box cover(const Box& box) const;
+    Wide area() const;
+    Wide distance(int64_t x, int64_t y) const;
+};
+
+bool RectangleIndex::Box::operator==(const Box& box) const{
+    return xlo == box.xlo && ylo == box.ylo && xhi == box.xhi && yhi == box.yhi;
+}
+
+bool RectangleIndex::Box::contains(const Box& box) const{
+    return xlo <= box.xlo && ylo <= box.ylo && box.xhi <= xhi && box.yhi <= yhi;
+}
+
+bool RectangleIndex::Box::intersects(const Box& box) const{
+    return xlo <= box.xhi && box.xlo <= xhi && ylo <= box.yhi && box.ylo <= yhi;
+}
+
+RectangleIndex::Box RectangleIndex::Box::cover(const Box& box) const{
+    return Box{std::min(xlo, box.xlo), std::min(ylo, box.ylo), std::max(xhi, box.xhi), std::max(yhi, box.yhi)};
+}
+
+Wide RectangleIndex::Box::area() const{
+    return multiply(xhi - xlo, yhi - ylo);
+}
+
+// Squared, so that it is exact.
+Wide RectangleIndex::Box::distance(int64_t x, int64_t y) const{
+    uint64_t dx = std::max<int64_t>({xlo - x, 0, x - xhi});
+    uint64_t dy = std::max<int64_t>({ylo - y, 0, y - yhi});
+    return multiply(dx, dx) + multiply(dy, dy);
+}
+
+RectangleIndex::RectangleIndex(): root(0), count(0) {
+    root = newNode(0);
+}
+
+// Defined here, where Box is complete.
+RectangleIndex::RectangleIndex(const RectangleIndex&) = default;
+RectangleIndex::RectangleIndex(RectangleIndex &&) = default;
+RectangleIndex::~RectangleIndex() = default;
+RectangleIndex& RectangleIndex::operator=(const RectangleIndex&) = default;
+RectangleIndex& RectangleIndex::operator=(RectangleIndex &&) = default;
+
+RectangleIndex::RectangleIndex(const Rectangles& rectangles): root(0), count(rectangles.size()) {
+    std::vector<Box> boxes;
+    std::vector<std::pair<uint64_t, size_t>> order;
+    boxes.reserve(count);
+    order.reserve(count);
+    for(size_t i = 0; i < count; i++){
+        Box box = boxOf(rectangles[i]);
+        boxes.push_back(box);
+        order.emplace_back(hilbertKey(gridCoordinate(box.xlo + box.xhi), gridCoordinate(box.ylo + box.yhi)), i);
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<size_t> level;
+    for(size_t i = 0; i < count; i += maxEntries){
+        size_t leaf = newNode(0);
+        for(size_t j = i; j < std::min(count, i + maxEntries); j++){
+            nodes[leaf].boxes.push_back(boxes[order[j].second]);
+            nodes[leaf].refs.push_back(order[j].second);
+        }
+        level.push_back(leaf);
+    }
+    for(uint32_t height = 1; level.size() > 1; height++){
+        std::vector<size_t> parents;
+        for(size_t i = 0; i < level.size(); i += maxEntries){
+            size_t parent = newNode(height);
+            for(size_t j = i; j < std::min(level.size(), i + maxEntries); j++){
+                nodes[parent].boxes.push_back(cover(level[j]));
+                nodes[parent].refs.push_back(level[j]);
+            }
+            parents.push_back(parent);
+        }
+        level = std::move(parents);
+    }
+    root = level.empty() ? newNode(0) : level[0];
+}
+
+size_t RectangleIndex::size() const{
+    return count;
+}
+
+RectangleIndex::Box RectangleIndex::boxOf(const Rectangle& rect){
+    int64_t x = rect.pos().x();
+    int64_t y = rect.pos().y();
+    return Box{x, y, x + rect.width(), y + rect.height()};
+}
+
+size_t RectangleIndex::newNode(uint32_t level){
+    if(freeNodes.empty()){
+        nodes.push_back(Node{level, {}, {}});
+        return nodes.size() - 1;
+    }
+    size_t node = freeNodes.back();
+    freeNodes.pop_back();
+    nodes[node].level = level;
+    return node;
+}
+
+void RectangleIndex::freeNode(size_t node){
+    nodes[node].boxes.clear();
+    nodes[node].refs.clear();
+    freeNodes.push_back(node);
+}
+
+RectangleIndex::Box RectangleIndex::cover(size_t node) const{
+    const std::vector<Box>& boxes = nodes[node].boxes;
+    Box result = boxes[0];
+    for(const Box& box: boxes){
+        result = result.cover(box);
+    }
+    return result;
+}
+
+// Entry of node whose box grows least when extended to box, the smallest one on ties.
+size_t RectangleIndex::chooseEntry(size_t node, const Box& box) const{
+    const std::vector<Box>& boxes = nodes[node].boxes;
+    size_t best = 0;
+    Wide bestGrowth{0, 0}, bestArea{0, 0};
+    for(size_t i = 0; i < boxes.size(); i++){
+        Wide area = boxes[i].area();
+        Wide growth = boxes[i].cover(box).area() - area;
+        if(i == 0 || growth < bestGrowth || (growth == bestGrowth && area < bestArea)){
+            best = i;
+            bestGrowth = growth;
+            bestArea = area;
+        }
+    }
+    return best;
+}
+
+// Moves part of entries of an overfull node to a new sibling and returns it (quadratic split). The two entries that
+// would waste most area together start the two groups; then the entry with the strongest preference joins
+// the group it enlarges less, until the rest is needed to fill a group up to minEntries.
+size_t RectangleIndex::split(size_t node){
+    std::vector<Box> boxes = std::move(nodes[node].boxes);
+    std::vector<size_t> refs = std::move(nodes[node].refs);
+    nodes[node].boxes.clear();
+    nodes[node].refs.clear();
+    size_t sibling = newNode(nodes[node].level);
+    size_t n = boxes.size();
+
+    // Waste may be negative, so instead of it compare cover areas with the other pair's areas added.
+    std::vector<Wide> areas;
+    for(const Box& box: boxes){
+        areas.push_back(box.area());
+    }
+    size_t seed1 = 0, seed2 = 1;
+    Wide worst = boxes[0].cover(boxes[1]).area();
+    for(size_t i = 0; i < n; i++){
+        for(size_t j = i + 1; j < n; j++){
+            Wide waste = boxes[i].cover(boxes[j]).area();
+            if(waste + areas[seed1] + areas[seed2] > worst + areas[i] + areas[j]){
+                seed1 = i;
+                seed2 = j;
+                worst = waste;
+            }
+        }
+    }
+
+    size_t groups[2] = {node, sibling};
+    Box covers[2] = {boxes[seed1], boxes[seed2]};
+    std::vector<bool> assigned(n, false);
+    auto assign = [&](size_t i, int group){
+        nodes[groups[group]].boxes.push_back(boxes[i]);
+        nodes[groups[group]].refs.push_back(refs[i]);
+        covers[group] = covers[group].cover(boxes[i]);
+        assigned[i] = true;
+    };
+    assign(seed1, 0);
+    assign(seed2, 1);
+
+    for(size_t remaining = n - 2; remaining > 0; remaining--){
+        int forced = -1;
+        for(int group = 0; group < 2; group++){
+            if(nodes[groups[group]].refs.size() + remaining <= minEntries){
+                forced = group;
+            }
+        }
+
+        size_t pick = n;
+        int group = 0;
+        Wide strongest{0, 0};
+        Wide coverAreas[2] = {covers[0].area(), covers[1].area()};
+        for(size_t i = 0; i < n; i++){
+            if(assigned[i]){
+                continue;
+            }
+            Wide growth0 = covers[0].cover(boxes[i]).area() - coverAreas[0];
+            Wide growth1 = covers[1].cover(boxes[i]).area() - coverAreas[1];
+            Wide preference = growth0 > growth1 ? growth0 - growth1 : growth1 - growth0;
+            if(pick == n || preference > strongest){
+                strongest = preference;
+                pick = i;
+                if(growth0 != growth1){
+                    group = growth0 < growth1 ? 0 : 1;
+                } else if(coverAreas[0] != coverAreas[1]){
+                    group = coverAreas[0] < coverAreas[1] ? 0 : 1;
+                } else {
+                    group = nodes[groups[0]].refs.size() <= nodes[groups[1]].refs.size() ? 0 : 1;
+                }
+            }
+        }
+        assign(pick, forced >= 0 ? forced : group);
+    }
+    return sibling;
+}
+
+// Adds an entry to the leaf chosen by chooseEntry() on every level, enlarging boxes on the way down, and splits
+// overfull nodes on the way back up.
+void RectangleIndex::insertEntry(const Box& box, size_t id){
+    std::vector<size_t> path, slots;
+    size_t node = root;
+    while(nodes[node].level > 0){
+        size_t slot = chooseEntry(node, box);
+        nodes[node].boxes[slot] = nodes[node].boxes[slot].cover(box);
+        path.push_back(node);
+        slots.push_back(slot);
+        node = nodes[node].refs[slot];
+    }
+    nodes[node].boxes.push_back(box);
+    nodes[node].refs.push_back(id);
+
+    while(nodes[node].refs.size() > maxEntries){
+        size_t sibling = split(node);
+        if(path.empty()){
+            root = newNode(nodes[node].level + 1);
+            nodes[root].boxes = {cover(node), cover(sibling)};
+            nodes[root].refs = {node, sibling};
+            return;
+        }
+        size_t parent = path.back();
+        nodes[parent].boxes[slots.back()] = cover(node);
+        nodes[parent].boxes.push_back(cover(sibling));
+        nodes[parent].refs.push_back(sibling);
+        path.pop_back();
+        slots.pop_back();
+        node = parent;
+    }
+}
+
+void RectangleIndex::insert(size_t id, const Rectangle& rect){
+    insertEntry(boxOf(rect), id);
+    count++;
+}
+
+// Finds the leaf entry of rectangle id with given box. Path gets nodes from node down to the leaf, slots
+// the entries followed in them.
+bool RectangleIndex::findLeaf(size_t node, const Box& box, size_t id, std::vector<size_t>& path,
+                              std::vector<size_t>& slots) const{
+    const Node& n = nodes[node];
+    path.push_back(node);
+    for(size_t i = 0; i < n.refs.size(); i++){
+        if(n.level == 0){
+            if(n.refs[i] == id && n.boxes[i] == box){
+                slots.push_back(i);
+                return true;
+            }
+        } else if(n.boxes[i].contains(box)){
+            slots.push_back(i);
+            if(findLeaf(n.refs[i], box, id, path, slots)){
+                return true;
+            }
+            slots.pop_back();
+        }
+    }
+    path.pop_back();
+    return false;
+}
+
+// Frees subtree of node, inserting its rectangles again.
+void RectangleIndex::reinsert(size_t node){
+    Node removed = std::move(nodes[node]);
+    freeNode(node);
+    for(size_t i = 0; i < removed.refs.size(); i++){
+        if(removed.level == 0){
+            insertEntry(removed.boxes[i], removed.refs[i]);
+        } else {
+            reinsert(removed.refs[i]);
+        }
+    }
+}
+
+// Removes the entry, then dissolves nodes left with fewer than minEntries entries, reinserting their rectangles,
+// and shrinks boxes of the rest on the path.
+bool RectangleIndex::remove(size_t id, const Rectangle& rect){
+    std::vector<size_t> path, slots;
+    if(!findLeaf(root, boxOf(rect), id, path, slots)){
+        return false;
+    }
+    Node& leaf = nodes[path.back()];
+    leaf.boxes.erase(leaf.boxes.begin() + slots.back());
+    leaf.refs.erase(leaf.refs.begin() + slots.back());
+    count--;
+
+    std::vector<size_t> orphans;
+    for(size_t depth = path.size() - 1; depth > 0; depth--){
+        size_t node = path[depth];
+        Node& parent = nodes[path[depth - 1]];
+        size_t slot = slots[depth - 1];
+        if(nodes[node].refs.size() < minEntries){
+            parent.boxes.erase(parent.boxes.begin() + slot);
+            parent.refs.erase(parent.refs.begin() + slot);
+            orphans.push_back(node);
+        } else {
+            parent.boxes[slot] = cover(node);
+        }
+    }
+    while(nodes[root].level > 0 && nodes[root].refs.size() <= 1){
+        size_t child = nodes[root].refs.empty() ? newNode(0) : nodes[root].refs[0];
+        freeNode(root);
+        root = child;
+    }
+    for(size_t node: orphans){
+        reinsert(node);
+    }
+    return true;
+}
+
+std::vector<size_t> RectangleIndex::search(const Box& window) const{
+    std::vector<size_t> result;
+    std::vector<size_t> pending = {root};
+    while(!pending.empty()){
+        const Node& n = nodes[pending.back()];
+        pending.pop_back();
+        for(size_t i = 0; i < n.refs.size(); i++){
+            if(n.boxes[i].intersects(window)){
+                (n.level == 0 ? result : pending).push_back(n.refs[i]);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<size_t> RectangleIndex::containing(const Position& pos) const{
+    return search(Box{pos.x(), pos.y(), pos.x(), pos.y()});
+}
+
+std::vector<size_t> RectangleIndex::intersecting(const Rectangle& window) const{
+    return search(boxOf(window));
+}
+
+// Best-first search: nodes and rectangles wait in one queue ordered by distance, so rectangles come out nearest
+// first, each before any node that could hold a nearer one.
+std::vector<size_t> RectangleIndex::nearest(const Position& pos, size_t k) const{
+    struct Candidate{
+        Wide distance;
+        bool rectangle;
+        size_t ref;
+
+        bool operator<(const Candidate& c) const{
+            return distance != c.distance ? distance > c.distance : rectangle < c.rectangle;
+        }
+    };
+
+    std::vector<size_t> result;
+    std::priority_queue<Candidate> queue;
+    queue.push(Candidate{Wide{0, 0}, false, root});
+    while(!queue.empty() && result.size() < k){
+        Candidate c = queue.top();
+        queue.pop();
+        if(c.rectangle){
+            result.push_back(c.ref);
+            continue;
+        }
+        const Node& n = nodes[c.ref];
+        for(size_t i = 0; i < n.refs.size(); i++){
+            queue.push(Candidate{n.boxes[i].distance(pos.x(), pos.y()), n.level == 0, n.refs[i]});
+        }
+    }
+    return result;
+}
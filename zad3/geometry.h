@@ -2,6 +2,7 @@
 #define GEOMETRY_H
 
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 #include <initializer_list>
 
@@ -9,6 +10,7 @@ class Position;
 class Vector;
 class Rectangle;
 class Rectangles;
+class RectangleIndex;
 
 class AbstractVector2D{
 protected:
@@ -96,21 +98,70 @@ public:
 
 class Rectangles{
     private:
-    std::vector<Rectangle> storage;
+    // Rectangle i has size widths[i] x heights[i] and its lower left corner at (xs[i] + dx, ys[i] + dy), added
+    // modulo 2^32. Translating the whole collection only adds to the pending offset (dx, dy).
+    std::vector<uint32_t> xs, ys;
+    std::vector<uint32_t> widths, heights;
+    uint32_t dx, dy;
+    // Least and greatest corner coordinates, against which translations are checked for overflow. Recomputed
+    // before the next translation once a rectangle on the boundary is replaced.
+    int32_t minX, maxX, minY, maxY;
+    bool extentStale;
+
+    void checkIndex(size_t i) const;
+    Rectangle get(size_t i) const;
+    void set(size_t i, const Rectangle& rect);
+    void extend(const Position& corner);
+    void recomputeExtent();
 
     public:
+    // Stands for a rectangle of the collection, which keeps no Rectangle objects to refer to. Reads and
+    // modifications go straight to the collection.
+    class Reference{
+        private:
+        Rectangles& owner;
+        size_t index;
+
+        Reference(Rectangles& owner, size_t index);
+
+        friend class Rectangles;
+
+    public:
+        Reference(const Reference&) = default;
+
+        Reference& operator=(const Reference& ref);
+        Reference& operator=(const Rectangle& rect);
+
+        operator Rectangle() const;
+
+        uint32_t width() const;
+        uint32_t height() const;
+        Position pos() const;
+
+        uint64_t area() const;
+
+        Rectangle reflection() const;
+
+        bool operator==(const Rectangle& rect) const;
+        Reference& operator+=(const Vector& vec);
+        Rectangle operator+(const Vector& vec) const;
+    };
+
     Rectangles();
     Rectangles(std::initializer_list<Rectangle> rectangles);
     Rectangles(const Rectangles&) = default;
-    Rectangles(Rectangles &&);
+    Rectangles(Rectangles &&) = default;
 
     Rectangles& operator=(const Rectangles&) = default;
-    Rectangles& operator=(Rectangles &&);
+    Rectangles& operator=(Rectangles &&) = default;
 
-    const Rectangle& operator[](size_t i) const;
-    Rectangle& operator[](size_t i);
+    Rectangle operator[](size_t i) const;
+    Reference operator[](size_t i);
     
     size_t size() const;
+    // Area covered by the rectangles, counting overlaps once. Throws std::invalid_argument if it does not fit
+    // in 64 bits.
+    uint64_t union_area() const;
 
     bool operator==(const Rectangles& rects) const;
 
@@ -119,8 +170,68 @@ class Rectangles{
     Rectangles operator+(const Vector& vec) &&;
 };
 
+// R-tree over rectangles, each known by an id. Built from a collection, where ids are positions of rectangles,
+// in O(n log n) by packing rectangles in Hilbert order of their centres, then kept up to date by insert() and
+// remove(). Rectangles are closed, so the ones sharing an edge or a corner with a window intersect it.
+class RectangleIndex{
+    private:
+    // Bounds of a rectangle or of a subtree. Defined in geometry.cc, since areas and distances of boxes take
+    // 128-bit arithmetic.
+    struct Box;
+
+    struct Node{
+        uint32_t level;
+        std::vector<Box> boxes;
+        // Ids of rectangles in leaves (level 0), indices of child nodes in other nodes.
+        std::vector<size_t> refs;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<size_t> freeNodes;
+    size_t root;
+    size_t count;
+
+    static Box boxOf(const Rectangle& rect);
+
+    size_t newNode(uint32_t level);
+    void freeNode(size_t node);
+    Box cover(size_t node) const;
+    size_t chooseEntry(size_t node, const Box& box) const;
+    size_t split(size_t node);
+    void insertEntry(const Box& box, size_t id);
+    bool findLeaf(size_t node, const Box& box, size_t id, std::vector<size_t>& path, std::vector<size_t>& slots) const;
+    void reinsert(size_t node);
+    std::vector<size_t> search(const Box& window) const;
+
+    public:
+    RectangleIndex();
+    explicit RectangleIndex(const Rectangles& rectangles);
+    RectangleIndex(const RectangleIndex&);
+    RectangleIndex(RectangleIndex &&);
+    ~RectangleIndex();
+
+    RectangleIndex& operator=(const RectangleIndex&);
+    RectangleIndex& operator=(RectangleIndex &&);
+
+    size_t size() const;
+
+    void insert(size_t id, const Rectangle& rect);
+    // Returns false if there is no rectangle rect with this id.
+    bool remove(size_t id, const Rectangle& rect);
+
+    // Ids of rectangles containing pos and of those intersecting window, in no particular order.
+    std::vector<size_t> containing(const Position& pos) const;
+    std::vector<size_t> intersecting(const Rectangle& window) const;
+    // Ids of k rectangles nearest to pos (of all, if there are fewer), nearest first. Distance is Euclidean,
+    // 0 for rectangles containing pos.
+    std::vector<size_t> nearest(const Position& pos, size_t k) const;
+};
+
 Rectangle merge_horizontally(const Rectangle& rect1, const Rectangle& rect2);
 Rectangle merge_vertically(const Rectangle& rect1, const Rectangle& rect2);
 Rectangle merge_all(const Rectangles& rectangles);
+// Merges rectangles given in any order, pairing up those sharing a whole edge until one is left. Throws
+// std::invalid_argument if they cannot be merged into one rectangle this way.
+Rectangle merge_unordered(const Rectangles& rectangles);
 
 #endif /* GEOMETRY_H */
\ No newline at end of file
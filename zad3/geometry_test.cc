@@ -0,0 +1,312 @@
+#include "geometry.h"
+
+#ifdef NDEBUG
+    #undef NDEBUG
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Tests of the index and the algorithms on collections against brute force. Built with
+// g++ -std=c++17 geometry.cc geometry_test.cc.
+
+namespace{
+    // Rectangles is built only from a list, so collections of up to maxListed rectangles are listed by
+    // a function chosen by their number.
+    const size_t maxListed = 64;
+
+    template <size_t... I>
+    Rectangles listed(const std::vector<Rectangle>& rects, std::index_sequence<I...>){
+        return Rectangles{rects[I]...};
+    }
+
+    template <size_t... N>
+    Rectangles collectionOf(const std::vector<Rectangle>& rects, std::index_sequence<N...>){
+        static Rectangles (*const list[])(const std::vector<Rectangle>&) = {
+            [](const std::vector<Rectangle>& r){ return listed(r, std::make_index_sequence<N>()); }...
+        };
+        return list[rects.size()](rects);
+    }
+
+    Rectangles collectionOf(const std::vector<Rectangle>& rects){
+        assert(rects.size() < maxListed);
+        return collectionOf(rects, std::make_index_sequence<maxListed>());
+    }
+
+    int64_t right(const Rectangle& rect){
+        return (int64_t) rect.pos().x() + rect.width();
+    }
+
+    int64_t top(const Rectangle& rect){
+        return (int64_t) rect.pos().y() + rect.height();
+    }
+
+    bool contains(const Rectangle& rect, int64_t x, int64_t y){
+        return rect.pos().x() <= x && x <= right(rect) && rect.pos().y() <= y && y <= top(rect);
+    }
+
+    bool intersect(const Rectangle& a, const Rectangle& b){
+        return a.pos().x() <= right(b) && b.pos().x() <= right(a) && a.pos().y() <= top(b)
+            && b.pos().y() <= top(a);
+    }
+
+    // Squared distance, which fits in 64 bits for points within 2^31 of the rectangle on both axes.
+    uint64_t distance(const Rectangle& rect, int64_t x, int64_t y){
+        uint64_t dx = std::max<int64_t>({rect.pos().x() - x, 0, x - right(rect)});
+        uint64_t dy = std::max<int64_t>({rect.pos().y() - y, 0, y - top(rect)});
+        return dx * dx + dy * dy;
+    }
+
+    std::vector<size_t> sorted(std::vector<size_t> ids){
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    // Compares queries of index, holding rectangles rects[i] with present[i], with scanning all of them.
+    void checkQueries(const RectangleIndex& index, const std::vector<Rectangle>& rects,
+                      const std::vector<bool>& present, std::mt19937& random){
+        assert(index.size() == (size_t) std::count(present.begin(), present.end(), true));
+        for(int query = 0; query < 100; query++){
+            int32_t x = (int32_t) (random() % 20000) - 10000;
+            int32_t y = (int32_t) (random() % 20000) - 10000;
+            Rectangle window(1 + random() % 2000, 1 + random() % 2000, Position(x, y));
+
+            std::vector<size_t> containing, intersecting;
+            std::vector<uint64_t> distances;
+            for(size_t i = 0; i < rects.size(); i++){
+                if(!present[i]){
+                    continue;
+                }
+                if(contains(rects[i], x, y)){
+                    containing.push_back(i);
+                }
+                if(intersect(rects[i], window)){
+                    intersecting.push_back(i);
+                }
+                distances.push_back(distance(rects[i], x, y));
+            }
+            std::sort(distances.begin(), distances.end());
+            assert(sorted(index.containing(Position(x, y))) == containing);
+            assert(sorted(index.intersecting(window)) == intersecting);
+
+            std::vector<size_t> nearest = index.nearest(Position(x, y), 10);
+            assert(nearest.size() == std::min<size_t>(10, distances.size()));
+            for(size_t j = 0; j < nearest.size(); j++){
+                assert(present[nearest[j]]);
+                assert(distance(rects[nearest[j]], x, y) == distances[j]);
+            }
+        }
+    }
+
+    void testIndex(){
+        std::mt19937 random(1);
+        std::vector<Rectangle> rects;
+        for(int i = 0; i < 3000; i++){
+            // Some far away, so that nodes cover much of the plane.
+            int32_t range = i % 100 == 0 ? 2000000000 : 10000;
+            rects.emplace_back(1 + random() % 300, 1 + random() % 300,
+                               Position((int32_t) ((int64_t) (random() % (2u * range)) - range),
+                                        (int32_t) ((int64_t) (random() % (2u * range)) - range)));
+        }
+        rects.emplace_back(UINT32_MAX, UINT32_MAX, Position(INT32_MIN, INT32_MIN));
+        rects.emplace_back(5, 5, Position(INT32_MAX, INT32_MAX));
+
+        RectangleIndex index;
+        std::vector<bool> present(rects.size(), false);
+        for(size_t i = 0; i < rects.size(); i++){
+            index.insert(i, rects[i]);
+            present[i] = true;
+        }
+        checkQueries(index, rects, present, random);
+        for(size_t round = 0; round < 4; round++){
+            for(size_t i = round; i < rects.size(); i += 3){
+                if(present[i]){
+                    assert(index.remove(i, rects[i]));
+                } else {
+                    index.insert(i, rects[i]);
+                }
+                present[i] = !present[i];
+            }
+            assert(!index.remove(0, Rectangle(1, 1, Position(123456, 0))));
+            checkQueries(index, rects, present, random);
+        }
+
+        RectangleIndex copy = index;
+        checkQueries(copy, rects, present, random);
+        for(size_t i = 0; i < rects.size(); i++){
+            if(present[i]){
+                assert(copy.remove(i, rects[i]));
+            }
+        }
+        assert(copy.size() == 0 && copy.nearest(Position(0, 0), 3).empty());
+        checkQueries(index, rects, present, random);
+    }
+
+    void testBulkIndex(){
+        std::mt19937 random(2);
+        std::vector<Rectangle> rects;
+        for(size_t i = 0; i + 1 < maxListed; i++){
+            rects.emplace_back(1 + random() % 3000, 1 + random() % 3000,
+                               Position((int32_t) (random() % 20000) - 10000, (int32_t) (random() % 20000) - 10000));
+        }
+        RectangleIndex index(collectionOf(rects));
+        std::vector<bool> present(rects.size(), true);
+        checkQueries(index, rects, present, random);
+
+        for(int i = 0; i < 500; i++){
+            rects.emplace_back(1 + random() % 300, 1 + random() % 300,
+                               Position((int32_t) (random() % 20000) - 10000, (int32_t) (random() % 20000) - 10000));
+            index.insert(rects.size() - 1, rects.back());
+            present.push_back(true);
+        }
+        for(size_t i = 0; i < rects.size(); i += 2){
+            assert(index.remove(i, rects[i]));
+            present[i] = false;
+        }
+        checkQueries(index, rects, present, random);
+
+        RectangleIndex empty{Rectangles()};
+        assert(empty.size() == 0 && empty.containing(Position(0, 0)).empty());
+    }
+
+    // Squared distances across the plane reach 2^65.
+    void testFarNearest(){
+        RectangleIndex index;
+        index.insert(0, Rectangle(1, 1, Position(INT32_MAX - 1, INT32_MAX - 1)));
+        index.insert(1, Rectangle(1, 1, Position(INT32_MAX - 1, INT32_MIN)));
+        index.insert(2, Rectangle(1, 1, Position(0, 0)));
+        assert(index.nearest(Position(INT32_MIN, INT32_MIN), 3) == std::vector<size_t>({2, 1, 0}));
+        assert(index.nearest(Position(INT32_MAX, INT32_MAX), 3) == std::vector<size_t>({0, 2, 1}));
+    }
+
+    bool mergeRejects(const std::vector<Rectangle>& rects){
+        try{
+            merge_unordered(collectionOf(rects));
+        } catch(const std::invalid_argument&){
+            return true;
+        }
+        return false;
+    }
+
+    // Tiling of whole into pieces made by cutting a random piece across k - 1 times, in random order.
+    std::vector<Rectangle> guillotineTiling(const Rectangle& whole, size_t k, std::mt19937& random){
+        std::vector<Rectangle> pieces{whole};
+        while(pieces.size() < k){
+            size_t i = random() % pieces.size();
+            Rectangle piece = pieces[i];
+            bool vertical = random() % 2 == 0;
+            uint32_t length = vertical ? piece.width() : piece.height();
+            if(length < 2){
+                continue;
+            }
+            uint32_t cut = 1 + random() % (length - 1);
+            if(vertical){
+                pieces[i] = Rectangle(cut, piece.height(), piece.pos());
+                pieces.emplace_back(length - cut, piece.height(),
+                                    Position((int32_t) (piece.pos().x() + (int64_t) cut), piece.pos().y()));
+            } else {
+                pieces[i] = Rectangle(piece.width(), cut, piece.pos());
+                pieces.emplace_back(piece.width(), length - cut,
+                                    Position(piece.pos().x(), (int32_t) (piece.pos().y() + (int64_t) cut)));
+            }
+        }
+        std::shuffle(pieces.begin(), pieces.end(), random);
+        return pieces;
+    }
+
+    void testMergeUnordered(){
+        std::mt19937 random(3);
+        for(int round = 0; round < 2000; round++){
+            Rectangle whole(1 + random() % 100, 1 + random() % 100,
+                            Position((int32_t) (random() % 2000000) - 1000000,
+                                     (int32_t) (random() % 2000000) - 1000000));
+            size_t k = 1 + random() % std::min<uint64_t>(maxListed - 1, whole.area());
+            std::vector<Rectangle> pieces = guillotineTiling(whole, k, random);
+            assert(merge_unordered(collectionOf(pieces)) == whole);
+
+            if(k > 1){
+                // A piece repeated in place of another overlaps itself and leaves a hole.
+                pieces[0] = pieces[1];
+                assert(mergeRejects(pieces));
+            }
+        }
+
+        // At the edges of the plane; merged sides must not exceed INT32_MAX.
+        for(const Rectangle& whole: {Rectangle(INT32_MAX, INT32_MAX, Position(INT32_MIN, INT32_MIN)),
+                                     Rectangle(INT32_MAX, INT32_MAX, Position(0, 0))}){
+            assert(merge_unordered(collectionOf(guillotineTiling(whole, 40, random))) == whole);
+        }
+
+        // Overlapping ones with areas adding up to the area of their bounding box.
+        assert(mergeRejects({Rectangle(2, 1, Position(0, 0)), Rectangle(1, 1, Position(0, 0)),
+                             Rectangle(1, 1, Position(1, 1))}));
+        assert(mergeRejects({Rectangle(2, 1, Position(0, 0)), Rectangle(2, 1, Position(1, 0))}));
+        assert(mergeRejects({Rectangle(1, 1, Position(0, 0)), Rectangle(1, 1, Position(0, 0))}));
+        assert(mergeRejects({Rectangle(1, 1, Position(0, 0)), Rectangle(1, 1, Position(2, 0))}));
+        // Pinwheel tiles its 3 x 3 bounding box, but no two of its rectangles share a whole edge.
+        assert(mergeRejects({Rectangle(2, 1, Position(0, 0)), Rectangle(1, 2, Position(2, 0)),
+                             Rectangle(2, 1, Position(1, 2)), Rectangle(1, 2, Position(0, 1)),
+                             Rectangle(1, 1, Position(1, 1))}));
+        assert(mergeRejects({}));
+    }
+
+    bool areaOverflows(const Rectangles& rects){
+        try{
+            rects.union_area();
+        } catch(const std::invalid_argument&){
+            return true;
+        }
+        return false;
+    }
+
+    void testUnionArea(){
+        std::mt19937 random(4);
+        const int grid = 24;
+        for(int round = 0; round < 2000; round++){
+            std::vector<Rectangle> rects;
+            bool covered[grid][grid] = {};
+            size_t k = random() % 20;
+            for(size_t i = 0; i < k; i++){
+                uint32_t width = 1 + random() % 8, height = 1 + random() % 8;
+                int32_t x = random() % (grid - width + 1), y = random() % (grid - height + 1);
+                rects.emplace_back(width, height, Position(x, y));
+                for(int32_t cx = x; cx < x + (int32_t) width; cx++){
+                    for(int32_t cy = y; cy < y + (int32_t) height; cy++){
+                        covered[cx][cy] = true;
+                    }
+                }
+            }
+            uint64_t cells = 0;
+            for(int cx = 0; cx < grid; cx++){
+                cells += std::count(covered[cx], covered[cx] + grid, true);
+            }
+
+            Rectangles collection = collectionOf(rects);
+            assert(collection.union_area() == cells);
+            collection += Vector(-1000000, 2000000);
+            assert(collection.union_area() == cells);
+        }
+
+        uint64_t plane = (uint64_t) UINT32_MAX * UINT32_MAX;
+        assert(Rectangles{Rectangle(UINT32_MAX, UINT32_MAX, Position(INT32_MIN, INT32_MIN))}.union_area() == plane);
+        assert((Rectangles{Rectangle(UINT32_MAX, UINT32_MAX, Position(INT32_MIN, INT32_MIN)),
+                           Rectangle(5, 7, Position(0, 0)), Rectangle(1, UINT32_MAX, Position(INT32_MAX, INT32_MIN))}
+                    .union_area() == plane + UINT32_MAX));
+        assert(areaOverflows(Rectangles{Rectangle(UINT32_MAX, UINT32_MAX, Position(INT32_MIN, INT32_MIN)),
+                                        Rectangle(UINT32_MAX, UINT32_MAX, Position(INT32_MAX, INT32_MAX))}));
+        assert(Rectangles().union_area() == 0);
+    }
+}
+
+int main(){
+    testIndex();
+    testBulkIndex();
+    testFarNearest();
+    testMergeUnordered();
+    testUnionArea();
+}